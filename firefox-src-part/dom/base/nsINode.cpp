@@ -31,11 +31,13 @@
 #include "mozilla/Preferences.h"
 #include "mozilla/PresShell.h"
 #include "mozilla/ProfilerLabels.h"
+#include "mozilla/ProfilerMarkers.h"
 #include "mozilla/ServoBindings.h"
 #include "mozilla/StaticPrefs_layout.h"
 #include "mozilla/TextControlElement.h"
 #include "mozilla/TextControlState.h"
 #include "mozilla/TextEditor.h"
+#include "mozilla/TextUtils.h"
 #include "mozilla/TimeStamp.h"
 #include "mozilla/dom/AncestorIterator.h"
 #include "mozilla/dom/Attr.h"
@@ -98,6 +100,7 @@
 #include "nsIAnonymousContentCreator.h"
 #include "nsIContentInlines.h"
 #include "nsIFrameInlines.h"
+#include "nsIMemoryReporter.h"
 #include "nsIScriptGlobalObject.h"
 #include "nsIWidget.h"
 #include "nsLayoutUtils.h"
@@ -109,6 +112,7 @@
 #include "nsPrintfCString.h"
 #include "nsRange.h"
 #include "nsString.h"
+#include "nsStubMutationObserver.h"
 #include "nsStyleConsts.h"
 #include "nsTHashMap.h"
 #include "nsTextNode.h"
@@ -572,6 +576,48 @@ nsIPolicyContainer* nsINode::GetPolicyContainer() const {
   return OwnerDoc()->GetPolicyContainer();
 }
 
+namespace {
+// The number and size of the nsSlots objects of live nodes. These come from
+// the DocGroup's DOMArena when there is one, which is released in bulk with
+// the DocGroup. Nodes only live on the main thread.
+size_t sLiveSlotsCount = 0;
+size_t sLiveSlotsBytes = 0;
+
+class DOMSlotsReporter final : public nsIMemoryReporter {
+  ~DOMSlotsReporter() = default;
+
+ public:
+  NS_DECL_ISUPPORTS
+
+  NS_IMETHOD CollectReports(nsIHandleReportCallback* aHandleReport,
+                            nsISupports* aData, bool aAnonymize) override {
+    MOZ_COLLECT_REPORT("dom-slots/count", KIND_OTHER, UNITS_COUNT,
+                       sLiveSlotsCount,
+                       "Number of DOM nodes with slots, which hold mutation "
+                       "observers, weak references and other rarely used "
+                       "per-node data.");
+    MOZ_COLLECT_REPORT("dom-slots/bytes", KIND_OTHER, UNITS_BYTES,
+                       sLiveSlotsBytes,
+                       "Memory used by the slots of DOM nodes, excluding "
+                       "what the slots point to.");
+    return NS_OK;
+  }
+};
+
+NS_IMPL_ISUPPORTS(DOMSlotsReporter, nsIMemoryReporter)
+}  // namespace
+
+void nsINode::DidCreateSlots() {
+  MOZ_ASSERT(NS_IsMainThread());
+  static bool sReporterRegistered = false;
+  if (!sReporterRegistered) {
+    sReporterRegistered = true;
+    RegisterStrongMemoryReporter(do_AddRef(new DOMSlotsReporter()));
+  }
+  ++sLiveSlotsCount;
+  sLiveSlotsBytes += moz_malloc_size_of(mSlots);
+}
+
 void* nsINode::AllocateSlots(size_t aSize) {
   DOMArena* arena = nullptr;
   if (HasFlag(NODE_KEEPS_DOMARENA)) {
@@ -1116,6 +1162,9 @@ void nsINode::LastRelease() {
       }
     }
 
+    MOZ_ASSERT(sLiveSlotsCount);
+    --sLiveSlotsCount;
+    sLiveSlotsBytes -= moz_malloc_size_of(slots);
     slots->~nsSlots();
     mSlots = nullptr;
     free(slots);
@@ -3574,11 +3623,15 @@ uint32_t nsINode::Length() const {
 namespace {
 class SelectorCacheKey {
  public:
-  explicit SelectorCacheKey(const nsACString& aString) : mKey(aString) {
+  SelectorCacheKey(const nsACString& aString, size_t aSize)
+      : mKey(aString), mSize(aSize) {
     MOZ_COUNT_CTOR(SelectorCacheKey);
   }
 
   nsCString mKey;
+  // What this entry is charged against the cache budget, see
+  // SelectorCache::EstimateEntrySize.
+  size_t mSize;
   nsExpirationState mState;
 
   nsExpirationState* GetExpirationState() { return &mState; }
@@ -3588,12 +3641,18 @@ class SelectorCacheKey {
 
 class SelectorCache final : public nsExpirationTracker<SelectorCacheKey, 4> {
  public:
-  using SelectorList = UniquePtr<StyleSelectorList>;
-  using Table = nsTHashMap<nsCStringHashKey, SelectorList>;
+  struct Entry {
+    UniquePtr<StyleSelectorList> mList;
+    // Owned by the expiration tracker, and deleted in NotifyExpired(). Null
+    // if we failed to track the entry, in which case it's never evicted.
+    SelectorCacheKey* mKey = nullptr;
+  };
+  using Table = nsTHashMap<nsCStringHashKey, Entry>;
 
-  SelectorCache()
+  explicit SelectorCache(size_t aMaxBytes)
       : nsExpirationTracker<SelectorCacheKey, 4>(
-            1000, "SelectorCache"_ns, GetMainThreadSerialEventTarget()) {}
+            1000, "SelectorCache"_ns, GetMainThreadSerialEventTarget()),
+        mMaxBytes(aMaxBytes) {}
 
   void NotifyExpired(SelectorCacheKey* aSelector) final {
     MOZ_ASSERT(NS_IsMainThread());
@@ -3610,40 +3669,253 @@ class SelectorCache final : public nsExpirationTracker<SelectorCacheKey, 4> {
     // asynchronously, we should update the warning added in
     // mozalloc_handle_oom() as well.
     RemoveObject(aSelector);
+    MOZ_ASSERT(mBytes >= aSelector->mSize);
+    mBytes -= aSelector->mSize;
+    ++mEvictions;
     mTable.Remove(aSelector->mKey);
     delete aSelector;
   }
 
-  // We do not call MarkUsed because it would just slow down lookups and
-  // because we're OK expiring things after a few seconds even if they're
-  // being used.  Returns whether we actually had an entry for aSelector.
+  // Returns the cached selector list for aSelector, parsing it with aFrom if
+  // we don't have an entry yet.
   //
-  // If we have an entry and the selector list returned has a null
-  // StyleSelectorList*, that indicates that aSelector has already been
-  // parsed and is not a syntactically valid selector.
+  // If the selector list returned is null, that indicates that aSelector has
+  // already been parsed and is not a syntactically valid selector.
   template <typename F>
   StyleSelectorList* GetListOrInsertFrom(const nsACString& aSelector,
                                          F&& aFrom) {
     MOZ_ASSERT(NS_IsMainThread());
-    return mTable.LookupOrInsertWith(aSelector, std::forward<F>(aFrom)).get();
+    if (auto entry = mTable.Lookup(aSelector)) {
+      ++mHits;
+      if (entry->mKey) {
+        // Move the entry to the newest generation, so that both expiration
+        // and the byte budget drop the least recently used selectors first.
+        (void)MarkUsed(entry->mKey);
+      }
+      return entry->mList.get();
+    }
+
+    ++mMisses;
+    const size_t size = EstimateEntrySize(aSelector);
+    EvictToFit(size);
+
+    auto* key = new SelectorCacheKey(aSelector, size);
+    if (NS_WARN_IF(NS_FAILED(AddObject(key)))) {
+      delete key;
+      key = nullptr;
+    } else {
+      mBytes += size;
+    }
+    Entry& entry = mTable.InsertOrUpdate(
+        aSelector, Entry{std::forward<F>(aFrom)(), key});
+    return entry.mList.get();
+  }
+
+  size_t SizeOfIncludingThis(MallocSizeOf aMallocSizeOf) const {
+    size_t n = aMallocSizeOf(this);
+    n += mTable.ShallowSizeOfExcludingThis(aMallocSizeOf);
+    for (const auto& entry : mTable) {
+      n += entry.GetKey().SizeOfExcludingThisIfUnshared(aMallocSizeOf);
+      // This only measures the top-level allocation of the selector list; its
+      // Servo-side contents are accounted for by EstimateEntrySize.
+      n += aMallocSizeOf(entry.GetData().mList.get());
+      if (const SelectorCacheKey* key = entry.GetData().mKey) {
+        n += aMallocSizeOf(key);
+        n += key->mKey.SizeOfExcludingThisIfUnshared(aMallocSizeOf);
+      }
+    }
+    return n;
   }
 
+  size_t EstimatedBytes() const { return mBytes; }
+  uint64_t Hits() const { return mHits; }
+  uint64_t Misses() const { return mMisses; }
+  uint64_t Evictions() const { return mEvictions; }
+
   ~SelectorCache() { AgeAllGenerations(); }
 
  private:
+  // Servo doesn't tell us how much memory a parsed selector list uses, but
+  // it's roughly proportional to the length of the selector, so we charge a
+  // multiple of that plus the fixed per-entry overhead.
+  static size_t EstimateEntrySize(const nsACString& aSelector) {
+    constexpr size_t kBytesPerSelectorChar = 8;
+    return sizeof(SelectorCacheKey) + sizeof(Table::EntryType) +
+           aSelector.Length() * (2 + kBytesPerSelectorChar);
+  }
+
+  // Drops the least recently used generations of selectors until an entry of
+  // aSize bytes fits in the budget.
+  void EvictToFit(size_t aSize) {
+    if (!mMaxBytes || mBytes + aSize <= mMaxBytes) {
+      return;
+    }
+    const uint64_t evictionsBefore = mEvictions;
+    const size_t bytesBefore = mBytes;
+    while (mBytes && mBytes + aSize > mMaxBytes) {
+      AgeOneGeneration();
+    }
+    PROFILER_MARKER_TEXT(
+        "SelectorCache eviction", DOM, {},
+        nsPrintfCString("Evicted %" PRIu64 " selectors (%zu bytes)",
+                        mEvictions - evictionsBefore, bytesBefore - mBytes));
+  }
+
   Table mTable;
+  const size_t mMaxBytes;
+  size_t mBytes = 0;
+  uint64_t mHits = 0;
+  uint64_t mMisses = 0;
+  // Entries dropped either because they weren't used for a while or to stay
+  // within mMaxBytes.
+  uint64_t mEvictions = 0;
+};
+
+StaticAutoPtr<SelectorCache> sSelectorCache;
+StaticAutoPtr<SelectorCache> sChromeSelectorCache;
+
+MOZ_DEFINE_MALLOC_SIZE_OF(SelectorCacheMallocSizeOf)
+
+class SelectorCacheReporter final : public nsIMemoryReporter {
+  ~SelectorCacheReporter() = default;
+
+ public:
+  NS_DECL_ISUPPORTS
+
+  NS_IMETHOD CollectReports(nsIHandleReportCallback* aHandleReport,
+                            nsISupports* aData, bool aAnonymize) override {
+    Report(aHandleReport, aData, sSelectorCache, "content"_ns);
+    Report(aHandleReport, aData, sChromeSelectorCache, "chrome"_ns);
+    return NS_OK;
+  }
+
+ private:
+  static void Report(nsIHandleReportCallback* aHandleReport,
+                     nsISupports* aData, const SelectorCache* aCache,
+                     const nsACString& aKind) {
+    if (!aCache) {
+      return;
+    }
+    auto report = [&](const nsACString& aPath, int32_t aReportKind,
+                      int32_t aUnits, int64_t aAmount,
+                      const nsLiteralCString& aDescription) {
+      (void)aHandleReport->Callback(""_ns, aPath, aReportKind, aUnits, aAmount,
+                                    aDescription, aData);
+    };
+    report("explicit/dom/selector-cache/"_ns + aKind, KIND_HEAP, UNITS_BYTES,
+           aCache->SizeOfIncludingThis(SelectorCacheMallocSizeOf),
+           "Memory used by the cache of selectors parsed for querySelector() "
+           "and friends, excluding Servo's selector lists themselves."_ns);
+    report("selector-cache/"_ns + aKind + "/estimated-bytes"_ns, KIND_OTHER,
+           UNITS_BYTES, aCache->EstimatedBytes(),
+           "Estimated memory used by the selector cache, including Servo's "
+           "selector lists. This is what's checked against "
+           "dom.selector_cache.max_bytes."_ns);
+    report("selector-cache/"_ns + aKind + "/hits"_ns, KIND_OTHER,
+           UNITS_COUNT_CUMULATIVE, aCache->Hits(),
+           "Number of selector cache lookups that hit."_ns);
+    report("selector-cache/"_ns + aKind + "/misses"_ns, KIND_OTHER,
+           UNITS_COUNT_CUMULATIVE, aCache->Misses(),
+           "Number of selector cache lookups that had to parse the "
+           "selector."_ns);
+    report("selector-cache/"_ns + aKind + "/evictions"_ns, KIND_OTHER,
+           UNITS_COUNT_CUMULATIVE, aCache->Evictions(),
+           "Number of selectors dropped from the selector cache, either "
+           "because they went unused or to stay within its byte budget."_ns);
+  }
 };
 
+NS_IMPL_ISUPPORTS(SelectorCacheReporter, nsIMemoryReporter)
+
 SelectorCache& GetSelectorCache(bool aChromeRulesEnabled) {
-  static StaticAutoPtr<SelectorCache> sSelectorCache;
-  static StaticAutoPtr<SelectorCache> sChromeSelectorCache;
   auto& cache = aChromeRulesEnabled ? sChromeSelectorCache : sSelectorCache;
   if (!cache) {
-    cache = new SelectorCache();
+    if (!sSelectorCache && !sChromeSelectorCache) {
+      RegisterStrongMemoryReporter(do_AddRef(new SelectorCacheReporter()));
+    }
+    cache = new SelectorCache(
+        Preferences::GetUint("dom.selector_cache.max_bytes", 0));
     ClearOnShutdown(&cache);
   }
   return *cache;
 }
+
+static bool IsSelectorWhitespace(char aChar) {
+  return aChar == ' ' || aChar == '\t' || aChar == '\n' || aChar == '\r' ||
+         aChar == '\f';
+}
+
+// Returns the cache key for aSelector, which collapses runs of whitespace into
+// a single space and trims it from both ends, so that selectors which only
+// differ in formatting share a cache entry. Whitespace inside strings and
+// escapes is significant, and left alone. Selectors with comments are left
+// alone entirely, since quotes inside a comment don't start a string.
+const nsACString& NormalizeSelectorWhitespace(const nsACString& aSelector,
+                                              nsACString& aStorage) {
+  if (aSelector.Find("/*"_ns) != kNotFound) {
+    return aSelector;
+  }
+  const char* const begin = aSelector.BeginReading();
+  const char* const end = aSelector.EndReading();
+  bool needsNormalization = false;
+  for (const char* c = begin; c != end; ++c) {
+    if (IsSelectorWhitespace(*c) &&
+        (*c != ' ' || c == begin || c + 1 == end ||
+         IsSelectorWhitespace(c[1]))) {
+      needsNormalization = true;
+      break;
+    }
+  }
+  if (!needsNormalization) {
+    return aSelector;
+  }
+
+  aStorage.Truncate();
+  aStorage.SetCapacity(aSelector.Length());
+  char quote = 0;
+  bool pendingSpace = false;
+  for (const char* c = begin; c != end; ++c) {
+    if (quote) {
+      aStorage.Append(*c);
+      if (*c == '\\' && c + 1 != end) {
+        aStorage.Append(*++c);
+      } else if (*c == quote) {
+        quote = 0;
+      }
+      continue;
+    }
+    if (IsSelectorWhitespace(*c)) {
+      pendingSpace = !aStorage.IsEmpty();
+      continue;
+    }
+    if (pendingSpace) {
+      aStorage.Append(' ');
+      pendingSpace = false;
+    }
+    aStorage.Append(*c);
+    if (*c == '"' || *c == '\'') {
+      quote = *c;
+    } else if (*c == '\\' && c + 1 != end) {
+      if (!IsAsciiHexDigit(c[1])) {
+        aStorage.Append(*++c);
+        continue;
+      }
+      // A hex escape consumes up to six hex digits and a single whitespace
+      // character after them, which must not be collapsed into a combinator.
+      for (int digits = 0;
+           digits < 6 && c + 1 != end && IsAsciiHexDigit(c[1]); ++digits) {
+        aStorage.Append(*++c);
+      }
+      if (c + 1 != end && IsSelectorWhitespace(c[1])) {
+        aStorage.Append(*++c);
+        if (*c == '\r' && c + 1 != end && c[1] == '\n') {
+          aStorage.Append(*++c);
+        }
+      }
+    }
+  }
+  return aStorage;
+}
 }  // namespace
 
 const StyleSelectorList* nsINode::ParseSelectorList(
@@ -3652,12 +3924,14 @@ const StyleSelectorList* nsINode::ParseSelectorList(
   const bool chromeRulesEnabled = doc->ChromeRulesEnabled();
 
   SelectorCache& cache = GetSelectorCache(chromeRulesEnabled);
-  StyleSelectorList* list = cache.GetListOrInsertFrom(aSelectorString, [&] {
-    // Note that we want to cache even if null was returned, because we
-    // want to cache the "This is not a valid selector" result.
-    return WrapUnique(
-        Servo_SelectorList_Parse(&aSelectorString, chromeRulesEnabled));
-  });
+  nsAutoCString normalized;
+  StyleSelectorList* list = cache.GetListOrInsertFrom(
+      NormalizeSelectorWhitespace(aSelectorString, normalized), [&] {
+        // Note that we want to cache even if null was returned, because we
+        // want to cache the "This is not a valid selector" result.
+        return WrapUnique(
+            Servo_SelectorList_Parse(&aSelectorString, chromeRulesEnabled));
+      });
 
   if (!list) {
     // Invalid selector.
@@ -3668,6 +3942,48 @@ const StyleSelectorList* nsINode::ParseSelectorList(
   return list;
 }
 
+// Given the elements with some id in tree order, find the first one that is a
+// strict descendant of aRoot. If none found, return nullptr.
+static Element* FindFirstDescendantWithId(Span<Element* const> aElements,
+                                          const nsINode& aRoot) {
+  // Past this many candidates we stop checking IsInclusiveDescendantOf (which
+  // is O(depth)) for each one, and binary search instead.
+  constexpr size_t kMaxLinearScanLength = 16;
+
+  if (aElements.Length() <= kMaxLinearScanLength) {
+    for (Element* element : aElements) {
+      if (MOZ_UNLIKELY(element == &aRoot)) {
+        continue;
+      }
+
+      if (!element->IsInclusiveDescendantOf(&aRoot)) {
+        continue;
+      }
+
+      // We have an element with the right id and it's a strict descendant
+      // of aRoot.
+      return element;
+    }
+    return nullptr;
+  }
+
+  // Descendants of aRoot are contiguous in tree order and come right after
+  // aRoot, so the only candidate is the first element that follows aRoot.
+  // That's O(log(n) * depth) rather than O(n * depth) for long lists of
+  // duplicate ids.
+  auto candidate = std::upper_bound(
+      aElements.begin(), aElements.end(), &aRoot,
+      [](const nsINode* aNode, const Element* aElement) {
+        return nsContentUtils::CompareTreePosition<TreeKind::DOM>(
+                   aNode, aElement, nullptr) < 0;
+      });
+  if (candidate == aElements.end() ||
+      !(*candidate)->IsInclusiveDescendantOf(&aRoot)) {
+    return nullptr;
+  }
+  return *candidate;
+}
+
 // Given an id, find first element with that id under aRoot.
 // If none found, return nullptr. aRoot must be in the document.
 inline static Element* FindMatchingElementWithId(
@@ -3678,25 +3994,8 @@ inline static Element* FindMatchingElementWithId(
       aRoot.IsInUncomposedDoc() || aRoot.IsInShadowTree(),
       "Don't call me if the root is not in the document or in a shadow tree");
 
-  Span elements = aContainingDocOrShadowRoot.GetAllElementsForId(aId);
-
-  // XXXbz: Should we fall back to the tree walk if |elements| is long,
-  // for some value of "long"?
-  for (Element* element : elements) {
-    if (MOZ_UNLIKELY(element == &aRoot)) {
-      continue;
-    }
-
-    if (!element->IsInclusiveDescendantOf(&aRoot)) {
-      continue;
-    }
-
-    // We have an element with the right id and it's a strict descendant
-    // of aRoot.
-    return element;
-  }
-
-  return nullptr;
+  return FindFirstDescendantWithId(
+      aContainingDocOrShadowRoot.GetAllElementsForId(aId), aRoot);
 }
 
 Element* nsINode::QuerySelector(const nsACString& aSelector,
@@ -3729,6 +4028,138 @@ already_AddRefed<NodeList> nsINode::QuerySelectorAll(
   return contentList.forget();
 }
 
+/**
+ * An id -> elements index for the root of a subtree which is neither in a
+ * document nor in a shadow tree, which otherwise have their own id tables.
+ * Without it, every getElementById call on such a subtree would walk it.
+ *
+ * The table is bound to the root (see BindObject) and observes it, so any id
+ * attribute change or child list mutation in the subtree drops the index,
+ * which is then rebuilt on the next lookup. Once the root gets a parent, the
+ * table goes away, since lookups go through the new subtree root.
+ */
+class nsINode::DetachedIdTable final : public nsStubMutationObserver {
+ public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSIMUTATIONOBSERVER_ATTRIBUTECHANGED
+  NS_DECL_NSIMUTATIONOBSERVER_CONTENTAPPENDED
+  NS_DECL_NSIMUTATIONOBSERVER_CONTENTINSERTED
+  NS_DECL_NSIMUTATIONOBSERVER_CONTENTREMOVED
+  NS_DECL_NSIMUTATIONOBSERVER_NODEWILLBEDESTROYED
+  NS_DECL_NSIMUTATIONOBSERVER_PARENTCHAINCHANGED
+
+  static DetachedIdTable& GetOrCreateFor(nsINode& aRoot) {
+    if (nsSlots* slots = aRoot.GetExistingSlots()) {
+      for (const BoundObject& object : slots->mBoundObjects) {
+        if (object.mDtor == Unbind) {
+          return *static_cast<DetachedIdTable*>(object.mObject.get());
+        }
+      }
+    }
+    auto* table = new DetachedIdTable(aRoot);
+    aRoot.BindObject(table, Unbind);
+    aRoot.AddMutationObserver(table);
+    return *table;
+  }
+
+  // Returns the strict descendants of the root with the given id, in tree
+  // order.
+  Span<Element* const> GetAllElementsForId(const nsAString& aId) {
+    EnsureBuilt();
+    RefPtr<nsAtom> id = NS_AtomizeMainThread(aId);
+    if (auto entry = mTable.Lookup(id)) {
+      return entry.Data();
+    }
+    return {};
+  }
+
+ private:
+  explicit DetachedIdTable(nsINode& aRoot) : mRoot(&aRoot) {}
+  ~DetachedIdTable() = default;
+
+  // Called when the root unbinds us, either explicitly from Detach() or
+  // because it's going away or being unlinked.
+  static void Unbind(nsISupports* aObject, nsINode* aRoot) {
+    auto* table = static_cast<DetachedIdTable*>(aObject);
+    MOZ_ASSERT(table->mRoot == aRoot);
+    aRoot->RemoveMutationObserver(table);
+    table->Invalidate();
+    table->mRoot = nullptr;
+  }
+
+  void Invalidate() {
+    mTable.Clear();
+    mBuilt = false;
+  }
+
+  void Detach() {
+    if (!mRoot) {
+      return;
+    }
+    RefPtr<DetachedIdTable> kungFuDeathGrip(this);
+    nsCOMPtr<nsINode> root = mRoot;
+    root->UnbindObject(this);
+    Unbind(this, root);
+  }
+
+  void EnsureBuilt() {
+    MOZ_ASSERT(mRoot);
+    if (mBuilt) {
+      return;
+    }
+    for (nsIContent* kid = mRoot->GetFirstChild(); kid;
+         kid = kid->GetNextNode(mRoot)) {
+      if (!kid->IsElement()) {
+        continue;
+      }
+      if (nsAtom* id = kid->AsElement()->GetID()) {
+        mTable.LookupOrInsert(id).AppendElement(kid->AsElement());
+      }
+    }
+    mBuilt = true;
+  }
+
+  // The elements are kept alive by the subtree, and any removal from it
+  // invalidates the table.
+  nsTHashMap<RefPtr<nsAtom>, nsTArray<Element*>> mTable;
+  nsINode* MOZ_NON_OWNING_REF mRoot;
+  bool mBuilt = false;
+};
+
+NS_IMPL_ISUPPORTS(nsINode::DetachedIdTable, nsIMutationObserver)
+
+void nsINode::DetachedIdTable::AttributeChanged(Element*, int32_t aNameSpaceID,
+                                               nsAtom* aAttribute, AttrModType,
+                                               const nsAttrValue*) {
+  if (aNameSpaceID == kNameSpaceID_None && aAttribute == nsGkAtoms::id) {
+    Invalidate();
+  }
+}
+
+void nsINode::DetachedIdTable::ContentAppended(nsIContent*,
+                                              const ContentAppendInfo&) {
+  Invalidate();
+}
+
+void nsINode::DetachedIdTable::ContentInserted(nsIContent*,
+                                              const ContentInsertInfo&) {
+  Invalidate();
+}
+
+void nsINode::DetachedIdTable::ContentWillBeRemoved(nsIContent*,
+                                                   const ContentRemoveInfo&) {
+  Invalidate();
+}
+
+void nsINode::DetachedIdTable::NodeWillBeDestroyed(nsINode*) { Invalidate(); }
+
+void nsINode::DetachedIdTable::ParentChainChanged(nsIContent* aContent) {
+  if (aContent == mRoot && aContent->GetParentNode()) {
+    // No longer the root of a detached subtree.
+    Detach();
+  }
+}
+
 Element* nsINode::GetElementById(const nsAString& aId) {
   MOZ_ASSERT(!IsShadowRoot(), "Should use the faster version");
   MOZ_ASSERT(IsElement() || IsDocumentFragment(),
@@ -3743,16 +4174,18 @@ Element* nsINode::GetElementById(const nsAString& aId) {
     return FindMatchingElementWithId(aId, *AsElement(), *containingShadow);
   }
 
-  for (nsIContent* kid = GetFirstChild(); kid; kid = kid->GetNextNode(this)) {
-    if (!kid->IsElement()) {
-      continue;
-    }
-    nsAtom* id = kid->AsElement()->GetID();
-    if (id && id->Equals(aId)) {
-      return kid->AsElement();
-    }
+  // A detached subtree (a DocumentFragment, template contents, an element
+  // that hasn't been inserted yet, ...). Use the id table of its root, which
+  // is built on first use and kept until the subtree is mutated.
+  nsINode* root = SubtreeRoot();
+  MOZ_ASSERT(root->IsElement() || root->IsDocumentFragment());
+  Span<Element* const> elements =
+      DetachedIdTable::GetOrCreateFor(*root).GetAllElementsForId(aId);
+  if (root == this) {
+    // The table only contains strict descendants of the root.
+    return elements.IsEmpty() ? nullptr : elements[0];
   }
-  return nullptr;
+  return FindFirstDescendantWithId(elements, *this);
 }
 
 JSObject* nsINode::WrapObject(JSContext* aCx,
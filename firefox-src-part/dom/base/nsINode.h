@@ -1943,6 +1943,10 @@ class nsINode : public mozilla::dom::EventTarget {
   // This should really only be called for elements and document fragments.
   mozilla::dom::Element* GetElementById(const nsAString& aId);
 
+  // Lazily built id index for the root of a subtree that is neither in a
+  // document nor in a shadow tree. See GetElementById.
+  class DetachedIdTable;
+
   void AppendChildToChildList(nsIContent* aKid);
   void InsertChildToChildList(nsIContent* aKid, nsIContent* aNextSibling);
   void DisconnectChild(nsIContent* aKid);
@@ -2611,10 +2615,14 @@ class nsINode : public mozilla::dom::EventTarget {
 
   nsSlots* GetExistingSlots() const { return mSlots; }
 
+  // Accounts for the newly created mSlots in about:memory.
+  void DidCreateSlots();
+
   nsSlots* Slots() {
     if (!HasSlots()) {
       mSlots = CreateSlots();
       MOZ_ASSERT(mSlots);
+      DidCreateSlots();
     }
     return GetExistingSlots();
   }
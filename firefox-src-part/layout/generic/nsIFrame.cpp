@@ -33,6 +33,7 @@
 #include "mozilla/ReflowInput.h"
 #include "mozilla/RestyleManager.h"
 #include "mozilla/ResultExtensions.h"
+#include "mozilla/ReverseIterator.h"
 #include "mozilla/SVGIntegrationUtils.h"
 #include "mozilla/SVGMaskFrame.h"
 #include "mozilla/SVGObserverUtils.h"
@@ -100,6 +101,7 @@
 #include "nsStyleConsts.h"
 #include "nsStyleStructInlines.h"
 #include "nsStyleTransformMatrix.h"
+#include "nsTHashMap.h"
 #include "nsTableWrapperFrame.h"
 #include "nsTextControlFrame.h"
 #include "nsXULElement.h"
@@ -140,6 +142,7 @@
 #include "mozilla/LookAndFeel.h"
 #include "mozilla/MouseEvents.h"
 #include "mozilla/Preferences.h"
+#include "mozilla/ProfilerMarkers.h"
 #include "mozilla/ServoStyleSet.h"
 #include "mozilla/ServoStyleSetInlines.h"
 #include "mozilla/css/ImageLoader.h"
@@ -465,6 +468,19 @@ nsIFrame* NS_NewEmptyFrame(PresShell* aPresShell, ComputedStyle* aStyle) {
 nsIFrame::~nsIFrame() {
   MOZ_COUNT_DTOR(nsIFrame);
 
+  if (MOZ_UNLIKELY(sOffsetToRootCache)) {
+    ForgetCachedOffsetsToRoot();
+  }
+  if (MOZ_UNLIKELY(sTransformMatrixCache)) {
+    ForgetCachedTransformMatrices();
+  }
+  if (MOZ_UNLIKELY(sReflowStats)) {
+    ForgetReflowStatsFrame();
+  }
+  if (MOZ_UNLIKELY(sContentVisibilityCache)) {
+    ForgetCachedContentVisibility();
+  }
+
   MOZ_ASSERT(GetVisibility() != Visibility::ApproximatelyVisible,
              "Visible nsFrame is being destroyed");
 }
@@ -871,6 +887,10 @@ void nsIFrame::HandlePrimaryFrameStyleChange(ComputedStyle* aOldStyle) {
 
   const auto cv = disp->ContentVisibility(*this);
   if (!oldDisp || oldDisp->ContentVisibility(*this) != cv) {
+    // A new frame can't be in the content-visibility memo yet.
+    if (oldDisp && MOZ_UNLIKELY(sContentVisibilityCache)) {
+      ForgetCachedContentVisibility();
+    }
     if (cv == StyleContentVisibility::Auto) {
       PresShell()->RegisterContentVisibilityAutoFrame(this);
     } else {
@@ -1272,6 +1292,11 @@ void nsIFrame::DidSetComputedStyle(ComputedStyle* aOldComputedStyle) {
   }
 #endif
 
+  // Transforms, perspective and their origins all come from style.
+  if (MOZ_UNLIKELY(sTransformMatrixCache) && aOldComputedStyle) {
+    ForgetCachedTransformMatrices();
+  }
+
   MaybeScheduleReflowSVGNonDisplayText(this);
 
   Document* doc = PresContext()->Document();
@@ -2129,67 +2154,152 @@ Visibility nsIFrame::GetVisibility() const {
     return Visibility::Untracked;
   }
 
-  bool isSet = false;
-  uint32_t visibleCount = GetProperty(VisibilityStateProperty(), &isSet);
+  return mApproximateVisibleCount > 0 ? Visibility::ApproximatelyVisible
+                                       : Visibility::ApproximatelyNonVisible;
+}
+
+namespace {
+
+// Shares the ancestor walks of UpdateVisibilitySynchronously between frames.
+class VisibilityUpdater {
+ public:
+  // Returns whether aFrame is approximately visible within all of its ancestor
+  // scroll containers.
+  bool IsVisible(nsIFrame* aFrame);
+
+ private:
+  struct ScrollAncestor {
+    // The nearest scroll container strictly above the frame, or null if
+    // there's none before the top of the in-process, non-chrome documents.
+    nsIFrame* mFrame = nullptr;
+    // Whether the frame's coordinates map to mFrame's by a translation, in
+    // which case mapping a rect doesn't need to compute transforms.
+    bool mIsTranslation = true;
+  };
+
+  ScrollAncestor GetScrollAncestor(nsIFrame* aFrame);
+
+  // Memoized per frame, so that the frames below a common ancestor only walk
+  // up to it once between them.
+  nsTHashMap<nsPtrHashKey<nsIFrame>, ScrollAncestor> mScrollAncestors;
+};
 
-  MOZ_ASSERT(isSet,
-             "Should have a VisibilityStateProperty value "
-             "if NS_FRAME_VISIBILITY_IS_TRACKED is set");
+}  // namespace
 
-  return visibleCount > 0 ? Visibility::ApproximatelyVisible
-                          : Visibility::ApproximatelyNonVisible;
+// Returns the frame the visibility walk continues to after aFrame, or null.
+static nsIFrame* GetVisibilityParent(nsIFrame* aFrame) {
+  nsIFrame* parent = aFrame->GetParent();
+  if (!parent) {
+    parent = nsLayoutUtils::GetCrossDocParentFrameInProcess(aFrame);
+    if (parent && parent->PresContext()->IsChrome()) {
+      return nullptr;
+    }
+  }
+  return parent;
 }
 
-void nsIFrame::UpdateVisibilitySynchronously() {
-  mozilla::PresShell* presShell = PresShell();
-  if (!presShell) {
-    return;
+VisibilityUpdater::ScrollAncestor VisibilityUpdater::GetScrollAncestor(
+    nsIFrame* aFrame) {
+  if (auto entry = mScrollAncestors.Lookup(aFrame)) {
+    return entry.Data();
   }
 
-  if (presShell->AssumeAllFramesVisible()) {
-    presShell->EnsureFrameInApproximatelyVisibleList(this);
-    return;
+  // Walk up until we find a scroll container, or a frame whose scroll
+  // ancestor we know already.
+  AutoTArray<nsIFrame*, 32> chain;
+  ScrollAncestor ancestor;
+  for (nsIFrame* f = aFrame; f;) {
+    chain.AppendElement(f);
+    nsIFrame* parent = GetVisibilityParent(f);
+    if (!parent) {
+      break;
+    }
+    if (ScrollContainerFrame* sf = do_QueryFrame(parent)) {
+      ancestor.mFrame = sf;
+      break;
+    }
+    if (auto entry = mScrollAncestors.Lookup(parent)) {
+      ancestor = entry.Data();
+      break;
+    }
+    f = parent;
   }
 
-  bool visible = StyleVisibility()->IsVisible();
-  nsIFrame* f = GetParent();
-  nsRect rect = GetRectRelativeToSelf();
-  nsIFrame* rectFrame = this;
-  while (f && visible) {
-    if (ScrollContainerFrame* sf = do_QueryFrame(f)) {
-      nsRect transformedRect =
-          nsLayoutUtils::TransformFrameRectToAncestor(rectFrame, rect, f);
-      if (!sf->IsRectNearlyVisible(transformedRect)) {
-        visible = false;
-        break;
-      }
+  // Then fill in the frames we walked past, top down, since each of them can
+  // only map by a translation if the frames above it do too.
+  for (nsIFrame* f : Reversed(chain)) {
+    ancestor.mIsTranslation = ancestor.mIsTranslation && f->GetParent() &&
+                              !f->IsTransformed() &&
+                              !f->HasAnyStateBits(NS_FRAME_SVG_LAYOUT);
+    mScrollAncestors.InsertOrUpdate(f, ancestor);
+  }
+  return ancestor;
+}
+
+bool VisibilityUpdater::IsVisible(nsIFrame* aFrame) {
+  if (!aFrame->StyleVisibility()->IsVisible()) {
+    return false;
+  }
 
-      // In this code we're trying to synchronously update *approximate*
-      // visibility. (In the future we may update precise visibility here as
-      // well, which is why the method name does not contain 'approximate'.) The
-      // IsRectNearlyVisible() check above tells us that the rect we're checking
-      // is approximately visible within the scrollframe, but we still need to
-      // ensure that, even if it was scrolled into view, it'd be visible when we
-      // consider the rest of the document. To do that, we move transformedRect
-      // to be contained in the scrollport as best we can (it might not fit) to
-      // pretend that it was scrolled into view.
-      rect = transformedRect.MoveInsideAndClamp(sf->GetScrollPortRect());
-      rectFrame = f;
+  nsRect rect = aFrame->GetRectRelativeToSelf();
+  nsIFrame* rectFrame = aFrame;
+  while (true) {
+    const ScrollAncestor ancestor = GetScrollAncestor(rectFrame);
+    if (!ancestor.mFrame) {
+      return true;
     }
-    nsIFrame* parent = f->GetParent();
-    if (!parent) {
-      parent = nsLayoutUtils::GetCrossDocParentFrameInProcess(f);
-      if (parent && parent->PresContext()->IsChrome()) {
-        break;
-      }
+    ScrollContainerFrame* sf = do_QueryFrame(ancestor.mFrame);
+    nsRect transformedRect =
+        ancestor.mIsTranslation
+            ? rect + rectFrame->GetOffsetTo(ancestor.mFrame)
+            : nsLayoutUtils::TransformFrameRectToAncestor(rectFrame, rect,
+                                                          ancestor.mFrame);
+    if (!sf->IsRectNearlyVisible(transformedRect)) {
+      return false;
     }
-    f = parent;
+
+    // In this code we're trying to synchronously update *approximate*
+    // visibility. (In the future we may update precise visibility here as
+    // well, which is why the method name does not contain 'approximate'.) The
+    // IsRectNearlyVisible() check above tells us that the rect we're checking
+    // is approximately visible within the scrollframe, but we still need to
+    // ensure that, even if it was scrolled into view, it'd be visible when we
+    // consider the rest of the document. To do that, we move transformedRect
+    // to be contained in the scrollport as best we can (it might not fit) to
+    // pretend that it was scrolled into view.
+    rect = transformedRect.MoveInsideAndClamp(sf->GetScrollPortRect());
+    rectFrame = ancestor.mFrame;
   }
+}
 
-  if (visible) {
-    presShell->EnsureFrameInApproximatelyVisibleList(this);
-  } else {
-    presShell->RemoveFrameFromApproximatelyVisibleList(this);
+void nsIFrame::UpdateVisibilitySynchronously() {
+  nsIFrame* self = this;
+  UpdateVisibilitySynchronously(Span<nsIFrame* const>(&self, 1));
+}
+
+/* static */
+void nsIFrame::UpdateVisibilitySynchronously(Span<nsIFrame* const> aFrames) {
+  // Nothing can move while we compute the visibilities, so let the frames
+  // share their offsets and transforms, too.
+  AutoOffsetToRootCache offsetCache;
+  AutoTransformMatrixCache transformCache;
+  VisibilityUpdater updater;
+  AutoTArray<bool, 16> visible;
+  visible.SetCapacity(aFrames.Length());
+  for (nsIFrame* frame : aFrames) {
+    visible.AppendElement(!frame->PresShell()->AssumeAllFramesVisible() &&
+                          updater.IsVisible(frame));
+  }
+
+  // Then tell the pres shells, which may notify the frames.
+  for (size_t i = 0; i < aFrames.Length(); i++) {
+    nsIFrame* frame = aFrames[i];
+    mozilla::PresShell* presShell = frame->PresShell();
+    if (visible[i] || presShell->AssumeAllFramesVisible()) {
+      presShell->EnsureFrameInApproximatelyVisibleList(frame);
+    } else {
+      presShell->RemoveFrameFromApproximatelyVisibleList(frame);
+    }
   }
 }
 
@@ -2198,14 +2308,12 @@ void nsIFrame::EnableVisibilityTracking() {
     return;  // Nothing to do.
   }
 
-  MOZ_ASSERT(!HasProperty(VisibilityStateProperty()),
-             "Shouldn't have a VisibilityStateProperty value "
+  MOZ_ASSERT(mApproximateVisibleCount == 0,
+             "Shouldn't have a visible count "
              "if NS_FRAME_VISIBILITY_IS_TRACKED is not set");
 
-  // Add the state bit so we know to track visibility for this frame, and
-  // initialize the frame property.
+  // Add the state bit so we know to track visibility for this frame.
   AddStateBits(NS_FRAME_VISIBILITY_IS_TRACKED);
-  SetProperty(VisibilityStateProperty(), 0);
 
   mozilla::PresShell* presShell = PresShell();
   if (!presShell) {
@@ -2224,12 +2332,7 @@ void nsIFrame::DisableVisibilityTracking() {
     return;  // Nothing to do.
   }
 
-  bool isSet = false;
-  uint32_t visibleCount = TakeProperty(VisibilityStateProperty(), &isSet);
-
-  MOZ_ASSERT(isSet,
-             "Should have a VisibilityStateProperty value "
-             "if NS_FRAME_VISIBILITY_IS_TRACKED is set");
+  const uint32_t visibleCount = std::exchange(mApproximateVisibleCount, 0);
 
   RemoveStateBits(NS_FRAME_VISIBILITY_IS_TRACKED);
 
@@ -2246,19 +2349,11 @@ void nsIFrame::DecApproximateVisibleCount(
     /* = Nothing() */) {
   MOZ_ASSERT(HasAnyStateBits(NS_FRAME_VISIBILITY_IS_TRACKED));
 
-  bool isSet = false;
-  uint32_t visibleCount = GetProperty(VisibilityStateProperty(), &isSet);
-
-  MOZ_ASSERT(isSet,
-             "Should have a VisibilityStateProperty value "
-             "if NS_FRAME_VISIBILITY_IS_TRACKED is set");
-  MOZ_ASSERT(visibleCount > 0,
+  MOZ_ASSERT(mApproximateVisibleCount > 0,
              "Frame is already nonvisible and we're "
              "decrementing its visible count?");
 
-  visibleCount--;
-  SetProperty(VisibilityStateProperty(), visibleCount);
-  if (visibleCount > 0) {
+  if (--mApproximateVisibleCount > 0) {
     return;
   }
 
@@ -2269,16 +2364,10 @@ void nsIFrame::DecApproximateVisibleCount(
 void nsIFrame::IncApproximateVisibleCount() {
   MOZ_ASSERT(HasAnyStateBits(NS_FRAME_VISIBILITY_IS_TRACKED));
 
-  bool isSet = false;
-  uint32_t visibleCount = GetProperty(VisibilityStateProperty(), &isSet);
-
-  MOZ_ASSERT(isSet,
-             "Should have a VisibilityStateProperty value "
-             "if NS_FRAME_VISIBILITY_IS_TRACKED is set");
+  MOZ_ASSERT(mApproximateVisibleCount < UINT32_MAX,
+             "Visible count overflow?");
 
-  visibleCount++;
-  SetProperty(VisibilityStateProperty(), visibleCount);
-  if (visibleCount > 1) {
+  if (++mApproximateVisibleCount > 1) {
     return;
   }
 
@@ -6006,6 +6095,93 @@ static FrameTarget GetSelectionClosestFrameForLine(
   return GetSelectionClosestFrameForChild(closestFromIEnd, aPoint, aFlags);
 }
 
+// The block-direction end edges of a block's lines, so that hit-testing a
+// point against a block with lots of lines (a long <pre>, a log viewer) can
+// binary-search them rather than walking the whole line list on every mouse
+// move. It's dropped whenever the block is reflowed or dirtied, and it's only
+// built when those edges are monotonic, which they nearly always are.
+struct LineBEndIndex {
+  nsTArray<nsBlockFrame::LineIterator> mLines;
+  nsTArray<nscoord> mBEnds;
+};
+NS_DECLARE_FRAME_PROPERTY_DELETABLE(LineBEndIndexProperty, LineBEndIndex)
+
+// Blocks with fewer lines than this are cheap enough to walk.
+static constexpr uint32_t kMinLinesForLineBEndIndex = 64;
+
+static const LineBEndIndex* GetLineBEndIndex(nsBlockFrame* aBlock) {
+  if (aBlock->HasAnyStateBits(NS_FRAME_IS_DIRTY | NS_FRAME_HAS_DIRTY_CHILDREN |
+                              NS_FRAME_IN_REFLOW)) {
+    // Our lines may have been destroyed or are about to be moved around.
+    aBlock->RemoveProperty(LineBEndIndexProperty());
+    return nullptr;
+  }
+  if (const auto* index = aBlock->GetProperty(LineBEndIndexProperty())) {
+    if (index->mLines.IsEmpty()) {
+      return nullptr;
+    }
+#ifdef DEBUG
+    uint32_t i = 0;
+    for (auto line = aBlock->LinesBegin(), end = aBlock->LinesEnd();
+         line != end; ++line, ++i) {
+      MOZ_ASSERT(i < index->mLines.Length() && index->mLines[i] == line &&
+                     index->mBEnds[i] == line->BEnd(),
+                 "Stale line index, missing invalidation?");
+    }
+    MOZ_ASSERT(i == index->mLines.Length(), "Stale line index");
+#endif
+    return index;
+  }
+
+  auto index = MakeUnique<LineBEndIndex>();
+  uint32_t count = 0;
+  for (auto line = aBlock->LinesBegin(), end = aBlock->LinesEnd();
+       line != end && count < kMinLinesForLineBEndIndex; ++line) {
+    ++count;
+  }
+  if (count == kMinLinesForLineBEndIndex) {
+    nscoord lastBEnd = nscoord_MIN;
+    for (auto line = aBlock->LinesBegin(), end = aBlock->LinesEnd();
+         line != end; ++line) {
+      const nscoord bEnd = line->BEnd();
+      if (bEnd < lastBEnd) {
+        // Negative margins or similar; the linear walk handles that fine.
+        index->mLines.Clear();
+        index->mBEnds.Clear();
+        break;
+      }
+      index->mLines.AppendElement(line);
+      index->mBEnds.AppendElement(bEnd);
+      lastBEnd = bEnd;
+    }
+  }
+  // We record an empty index for small or non-monotonic blocks too, so that
+  // we don't re-examine them on every call.
+  const bool useIndex = !index->mLines.IsEmpty();
+  LineBEndIndex* stored = index.release();
+  aBlock->SetProperty(LineBEndIndexProperty(), stored);
+  return useIndex ? stored : nullptr;
+}
+
+static int32_t sDragOutOfFrameStyle = 0;
+
+static void DragOutOfFrameStyleChanged(const char*, void*) {
+  sDragOutOfFrameStyle = Preferences::GetInt("browser.drag_out_of_frame_style");
+}
+
+// This hidden pref dictates whether a point above or below all lines comes up
+// with a line or the beginning or end of the frame; 0 on Windows, 1 on other
+// platforms by default at the writing of this code.
+static int32_t DragOutOfFrameStyle() {
+  static bool sRegistered = false;
+  if (!sRegistered) {
+    sRegistered = true;
+    Preferences::RegisterCallbackAndCall(DragOutOfFrameStyleChanged,
+                                         "browser.drag_out_of_frame_style");
+  }
+  return sDragOutOfFrameStyle;
+}
+
 // This method is for the special handling we do for block frames; they're
 // special because they represent paragraphs and because they are organized
 // into lines, which have bounds that are not stored elsewhere in the
@@ -6028,19 +6204,36 @@ static FrameTarget GetSelectionClosestFrameForBlock(nsIFrame* aFrame,
     // Convert aPoint into a LogicalPoint in the writing-mode of this block
     WritingMode wm = curLine->mWritingMode;
     LogicalPoint pt(wm, aPoint, curLine->mContainerSize);
-    do {
-      // Check to see if our point lies within the line's block-direction bounds
-      nscoord BCoord = pt.B(wm) - curLine->BStart();
-      nscoord BSize = curLine->BSize();
-      if (BCoord >= 0 && BCoord < BSize) {
-        closestLine = curLine;
-        break;  // We found the line; stop looking
-      }
-      if (BCoord < 0) {
-        break;
+    if (const LineBEndIndex* index = GetLineBEndIndex(bf)) {
+      // The first line that ends after our point is the one the walk below
+      // would stop at.
+      const size_t i = std::upper_bound(index->mBEnds.begin(),
+                                        index->mBEnds.end(), pt.B(wm)) -
+                       index->mBEnds.begin();
+      if (i < index->mLines.Length()) {
+        curLine = index->mLines[i];
+        if (pt.B(wm) >= curLine->BStart()) {
+          closestLine = curLine;
+        }
+      } else {
+        curLine = end;
       }
-      ++curLine;
-    } while (curLine != end);
+    } else {
+      do {
+        // Check to see if our point lies within the line's block-direction
+        // bounds
+        nscoord BCoord = pt.B(wm) - curLine->BStart();
+        nscoord BSize = curLine->BSize();
+        if (BCoord >= 0 && BCoord < BSize) {
+          closestLine = curLine;
+          break;  // We found the line; stop looking
+        }
+        if (BCoord < 0) {
+          break;
+        }
+        ++curLine;
+      } while (curLine != end);
+    }
 
     if (closestLine == end) {
       nsBlockFrame::LineIterator prevLine = curLine.prev();
@@ -6053,11 +6246,7 @@ static FrameTarget GetSelectionClosestFrameForBlock(nsIFrame* aFrame,
         --prevLine;
       }
 
-      // This hidden pref dictates whether a point above or below all lines
-      // comes up with a line or the beginning or end of the frame; 0 on
-      // Windows, 1 on other platforms by default at the writing of this code
-      int32_t dragOutOfFrame =
-          Preferences::GetInt("browser.drag_out_of_frame_style");
+      const int32_t dragOutOfFrame = DragOutOfFrameStyle();
 
       if (prevLine == end) {
         if (dragOutOfFrame == 1 || nextLine == end) {
@@ -6263,8 +6452,13 @@ nsIFrame::ContentOffsets nsIFrame::GetContentOffsetsFromPoint(
 
   nsPoint adjustedPoint = aPoint + GetOffsetTo(adjustedFrame);
 
-  FrameTarget closest =
-      GetSelectionClosestFrame(adjustedFrame, adjustedPoint, aFlags);
+  // Looking for the closest frame checks whether each candidate is hidden by
+  // the content-visibility of an ancestor, and the candidates share most of
+  // their ancestors.
+  FrameTarget closest = [&] {
+    AutoContentVisibilityCache contentVisibilityCache;
+    return GetSelectionClosestFrame(adjustedFrame, adjustedPoint, aFlags);
+  }();
 
   // If the correct offset is at one end of a frame, use offset-based
   // calculation method
@@ -7646,10 +7840,221 @@ nscoord nsIFrame::ComputeISizeValue(const WritingMode aWM,
   return std::max(0, result);
 }
 
+// Release-build reflow statistics, enabled with MOZ_LOG=ReflowStats:3 or
+// ReflowStats:4. A sample covers one reflow pass, from the MarkInReflow of its
+// reflow root (a frame whose parent isn't in reflow) to the root's DidReflow.
+// At Info level, one in kReflowStatsSampleInterval passes is sampled; at Debug
+// level all of them are. For each sample, we count per frame class how many
+// frames got reflowed and why, and how long their Reflow took with and without
+// their descendants. The result is reported as JSON, to the log and as a
+// profiler marker, once the sample is over.
+//
+// Frames whose parent doesn't call DidReflow on them are accounted for when
+// their parent's DidReflow comes. If the root never gets its DidReflow, because
+// it got destroyed or the pass was abandoned, the sample is dropped unreported.
+LazyLogModule nsIFrame::sReflowStatsLog("ReflowStats");
+
+static constexpr uint32_t kReflowStatsSampleInterval = 16;
+
+enum class ReflowStatsReason : uint8_t {
+  Initial,        // NS_FRAME_FIRST_REFLOW
+  Dirty,          // NS_FRAME_IS_DIRTY, e.g. MarkSubtreeDirty or a restyle
+  DirtyChildren,  // NS_FRAME_HAS_DIRTY_CHILDREN, see ChildIsDirty
+  Resize,         // None of the above; our available size changed
+  Count,
+};
+
+static const char* const kReflowStatsReasonNames[] = {
+    "initial", "dirty", "dirty-children", "resize"};
+static_assert(std::size(kReflowStatsReasonNames) ==
+              size_t(ReflowStatsReason::Count));
+
+static const char* const kFrameClassNames[] = {
+#define FRAME_ID(class_, ...) #class_,
+#define ABSTRACT_FRAME_ID(...)
+#include "mozilla/FrameIdList.h"
+#undef FRAME_ID
+#undef ABSTRACT_FRAME_ID
+};
+
+struct nsIFrame::ReflowStats {
+  static_assert(std::size(kFrameClassNames) == kFrameClassCount);
+
+  struct Entry {
+    // Only compared against. Cleared when the frame is destroyed, so that a
+    // new frame at the same address can't be mistaken for it.
+    const nsIFrame* mFrame;
+    ClassID mClass;
+    TimeStamp mStart;
+    TimeDuration mDescendantsTime;
+  };
+  struct ClassStats {
+    uint32_t mCount = 0;
+    TimeDuration mSelfTime;
+    TimeDuration mInclusiveTime;
+    uint32_t mReasons[size_t(ReflowStatsReason::Count)] = {};
+  };
+
+  explicit ReflowStats(const mozilla::PresShell* aPresShell)
+      : mPresShell(aPresShell) {}
+
+  // Whether aFrame's reflow is part of this sample's pass, i.e. whether the
+  // sample's root is a strict ancestor of aFrame.
+  bool IsInPass(const nsIFrame* aFrame) const {
+    for (const nsIFrame* f = aFrame->GetParent(); f; f = f->GetParent()) {
+      if (f == mStack[0].mFrame) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Report() const;
+
+  const mozilla::PresShell* const mPresShell;
+  AutoTArray<Entry, 32> mStack;
+  ClassStats mClasses[kFrameClassCount];
+};
+
+nsIFrame::ReflowStats* nsIFrame::sReflowStats = nullptr;
+
+void nsIFrame::RecordReflowStart() {
+  MOZ_ASSERT(NS_IsMainThread());
+  const nsIFrame* parent = GetParent();
+  const bool isReflowRoot =
+      !parent || !parent->HasAnyStateBits(NS_FRAME_IN_REFLOW);
+  if (sReflowStats && isReflowRoot && !sReflowStats->IsInPass(this)) {
+    // A new pass started while the sampled one never got its root's
+    // DidReflow, so the sample will never end.
+    DropReflowStats();
+  }
+  if (!sReflowStats) {
+    if (!isReflowRoot) {
+      return;
+    }
+    static uint32_t sPassCount = 0;
+    if (sPassCount++ % kReflowStatsSampleInterval &&
+        !MOZ_LOG_TEST(sReflowStatsLog, LogLevel::Debug)) {
+      return;
+    }
+    sReflowStats = new ReflowStats(PresShell());
+  }
+
+  ReflowStatsReason reason = ReflowStatsReason::Resize;
+  if (HasAnyStateBits(NS_FRAME_FIRST_REFLOW)) {
+    reason = ReflowStatsReason::Initial;
+  } else if (HasAnyStateBits(NS_FRAME_IS_DIRTY)) {
+    reason = ReflowStatsReason::Dirty;
+  } else if (HasAnyStateBits(NS_FRAME_HAS_DIRTY_CHILDREN)) {
+    reason = ReflowStatsReason::DirtyChildren;
+  }
+  auto& classStats = sReflowStats->mClasses[size_t(mClass)];
+  classStats.mCount++;
+  classStats.mReasons[size_t(reason)]++;
+  sReflowStats->mStack.AppendElement(
+      ReflowStats::Entry{this, mClass, TimeStamp::Now(), TimeDuration()});
+}
+
+void nsIFrame::RecordReflowEnd() {
+  MOZ_ASSERT(sReflowStats);
+  auto& stack = sReflowStats->mStack;
+  const bool onStack = [&] {
+    for (const auto& entry : Reversed(stack)) {
+      if (entry.mFrame == this) {
+        return true;
+      }
+    }
+    return false;
+  }();
+  if (!onStack) {
+    // Reflowed before the sample started, or DidReflow was called without a
+    // reflow.
+    return;
+  }
+
+  const TimeStamp now = TimeStamp::Now();
+  bool done = false;
+  while (!done) {
+    const ReflowStats::Entry entry = stack.PopLastElement();
+    done = entry.mFrame == this;
+    const TimeDuration inclusive = now - entry.mStart;
+    auto& classStats = sReflowStats->mClasses[size_t(entry.mClass)];
+    classStats.mInclusiveTime += inclusive;
+    classStats.mSelfTime += inclusive - entry.mDescendantsTime;
+    if (!stack.IsEmpty()) {
+      stack.LastElement().mDescendantsTime += inclusive;
+    }
+  }
+
+  if (stack.IsEmpty()) {
+    sReflowStats->Report();
+    delete sReflowStats;
+    sReflowStats = nullptr;
+  }
+}
+
+void nsIFrame::DropReflowStats() {
+  MOZ_LOG(sReflowStatsLog, LogLevel::Debug, ("Dropping unfinished sample"));
+  delete sReflowStats;
+  sReflowStats = nullptr;
+}
+
+void nsIFrame::ForgetReflowStatsFrame() {
+  MOZ_ASSERT(sReflowStats);
+  auto& stack = sReflowStats->mStack;
+  if (stack[0].mFrame == this) {
+    DropReflowStats();
+    return;
+  }
+  for (auto& entry : stack) {
+    if (entry.mFrame == this) {
+      entry.mFrame = nullptr;
+    }
+  }
+}
+
+void nsIFrame::ReflowStats::Report() const {
+  nsAutoCString json;
+  json.AppendPrintf("{\"presShell\":\"%p\",\"classes\":{",
+                    static_cast<const void*>(mPresShell));
+  bool first = true;
+  for (size_t i = 0; i < kFrameClassCount; ++i) {
+    const ClassStats& stats = mClasses[i];
+    if (!stats.mCount) {
+      continue;
+    }
+    json.AppendPrintf(
+        "%s\"%s\":{\"count\":%u,\"selfMs\":%.3f,\"inclusiveMs\":%.3f,"
+        "\"reasons\":{",
+        first ? "" : ",", kFrameClassNames[i], stats.mCount,
+        stats.mSelfTime.ToMilliseconds(),
+        stats.mInclusiveTime.ToMilliseconds());
+    first = false;
+    bool firstReason = true;
+    for (size_t r = 0; r < size_t(ReflowStatsReason::Count); ++r) {
+      if (!stats.mReasons[r]) {
+        continue;
+      }
+      json.AppendPrintf("%s\"%s\":%u", firstReason ? "" : ",",
+                        kReflowStatsReasonNames[r], stats.mReasons[r]);
+      firstReason = false;
+    }
+    json.AppendLiteral("}}");
+  }
+  json.AppendLiteral("}}");
+
+  MOZ_LOG(sReflowStatsLog, LogLevel::Info, ("%s", json.get()));
+  PROFILER_MARKER_TEXT("ReflowStats", LAYOUT, {}, json);
+}
+
 void nsIFrame::DidReflow(nsPresContext* aPresContext,
                          const ReflowInput* aReflowInput) {
   NS_FRAME_TRACE(NS_FRAME_TRACE_CALLS, ("nsIFrame::DidReflow"));
 
+  if (MOZ_UNLIKELY(sReflowStats)) {
+    RecordReflowEnd();
+  }
+
   if (IsHiddenByContentVisibilityOfInFlowParentForLayout()) {
     RemoveStateBits(NS_FRAME_IN_REFLOW);
     return;
@@ -7660,6 +8065,11 @@ void nsIFrame::DidReflow(nsPresContext* aPresContext,
   RemoveStateBits(NS_FRAME_IN_REFLOW | NS_FRAME_FIRST_REFLOW |
                   NS_FRAME_IS_DIRTY | NS_FRAME_HAS_DIRTY_CHILDREN);
 
+  if (IsBlockFrameOrSubclass()) {
+    // Our lines may have moved, see GetSelectionClosestFrameForBlock.
+    RemoveProperty(LineBEndIndexProperty());
+  }
+
   // Clear bits that were used in ReflowInput::InitResizeFlags (see
   // comment there for why we can't clear it there).
   SetHasBSizeChange(false);
@@ -7742,22 +8152,112 @@ bool nsIFrame::IsHiddenByContentVisibilityOfInFlowParentForLayout() const {
            Style()->IsAnonBox());
 }
 
-nsIFrame* nsIFrame::GetClosestContentVisibilityAncestor(
-    const EnumSet<IncludeContentVisibility>& aInclude) const {
-  auto* parent = GetInFlowParent();
-  bool isAnonymousBlock = Style()->IsAnonBox() && parent &&
-                          parent->HasAnyStateBits(NS_FRAME_OWNS_ANON_BOXES);
-  for (nsIFrame* cur = parent; cur; cur = cur->GetInFlowParent()) {
-    if (!isAnonymousBlock && cur->HidesContent(aInclude)) {
-      return cur;
+static LazyLogModule sContentVisibilityCacheLog("ContentVisibilityCache");
+
+struct nsIFrame::ContentVisibilityCache {
+  // For every frame we walked past, and every set of content-visibility values
+  // it was queried for, the frame itself or its closest in-flow ancestor that
+  // hides its content, if any. Any frame stored as an answer is also a key.
+  struct Entry {
+    nsIFrame* mHider[4] = {};
+    uint8_t mKnown = 0;
+  };
+  nsTHashMap<nsPtrHashKey<const nsIFrame>, Entry> mEntries;
+  uint32_t mDepth = 0;
+  uint32_t mHits = 0;
+  uint32_t mMisses = 0;
+};
+
+nsIFrame::ContentVisibilityCache* nsIFrame::sContentVisibilityCache = nullptr;
+
+nsIFrame::AutoContentVisibilityCache::AutoContentVisibilityCache() {
+  MOZ_ASSERT(NS_IsMainThread());
+  if (!sContentVisibilityCache) {
+    sContentVisibilityCache = new ContentVisibilityCache();
+  }
+  sContentVisibilityCache->mDepth++;
+}
+
+nsIFrame::AutoContentVisibilityCache::~AutoContentVisibilityCache() {
+  MOZ_ASSERT(sContentVisibilityCache);
+  if (--sContentVisibilityCache->mDepth) {
+    return;
+  }
+  MOZ_LOG(sContentVisibilityCacheLog, LogLevel::Debug,
+          ("%u hits, %u misses, %u frames", sContentVisibilityCache->mHits,
+           sContentVisibilityCache->mMisses,
+           sContentVisibilityCache->mEntries.Count()));
+  delete sContentVisibilityCache;
+  sContentVisibilityCache = nullptr;
+}
+
+void nsIFrame::ForgetCachedContentVisibility() {
+  MOZ_ASSERT(sContentVisibilityCache);
+  sContentVisibilityCache->mEntries.Clear();
+}
+
+// Returns aFrame or its closest in-flow ancestor that hides its content, and
+// remembers that for aFrame and the ancestors we had to walk past.
+nsIFrame* nsIFrame::CachedClosestContentHider(
+    nsIFrame* aFrame, const EnumSet<IncludeContentVisibility>& aInclude) {
+  MOZ_ASSERT(sContentVisibilityCache);
+  auto& entries = sContentVisibilityCache->mEntries;
+  const auto index = aInclude.serialize();
+  MOZ_ASSERT(index < std::size(ContentVisibilityCache::Entry().mHider));
+  const uint8_t known = 1 << index;
+
+  AutoTArray<const nsIFrame*, 32> uncached;
+  nsIFrame* hider = nullptr;
+  for (nsIFrame* f = aFrame; f; f = f->GetInFlowParent()) {
+    if (auto cached = entries.Lookup(f);
+        cached && (cached.Data().mKnown & known)) {
+      hider = cached.Data().mHider[index];
+      break;
     }
+    uncached.AppendElement(f);
+    if (f->HidesContent(aInclude)) {
+      hider = f;
+      break;
+    }
+  }
+  if (uncached.IsEmpty()) {
+    sContentVisibilityCache->mHits++;
+  } else {
+    sContentVisibilityCache->mMisses++;
+  }
+  for (const nsIFrame* f : uncached) {
+    auto& entry = entries.LookupOrInsert(f);
+    entry.mHider[index] = hider;
+    entry.mKnown |= known;
+  }
+#ifdef DEBUG
+  nsIFrame* uncachedHider = aFrame;
+  while (uncachedHider && !uncachedHider->HidesContent(aInclude)) {
+    uncachedHider = uncachedHider->GetInFlowParent();
+  }
+  MOZ_ASSERT(hider == uncachedHider, "Stale content-visibility cache");
+#endif
+  return hider;
+}
 
+nsIFrame* nsIFrame::GetClosestContentVisibilityAncestor(
+    const EnumSet<IncludeContentVisibility>& aInclude) const {
+  nsIFrame* parent = GetInFlowParent();
+  if (parent && Style()->IsAnonBox() &&
+      parent->HasAnyStateBits(NS_FRAME_OWNS_ANON_BOXES)) {
     // Anonymous boxes are not hidden by the content-visibility of their first
     // non-anonymous ancestor, but can be hidden by ancestors further up the
     // tree.
-    isAnonymousBlock = false;
+    parent = parent->GetInFlowParent();
+  }
+  if (sContentVisibilityCache) {
+    return parent ? CachedClosestContentHider(parent, aInclude) : nullptr;
+  }
+  for (nsIFrame* cur = parent; cur; cur = cur->GetInFlowParent()) {
+    if (cur->HidesContent(aInclude)) {
+      return cur;
+    }
   }
-
   return nullptr;
 }
 
@@ -7882,6 +8382,9 @@ bool nsIFrame::UpdateIsRelevantContent(
     return false;
   }
 
+  if (MOZ_UNLIKELY(sContentVisibilityCache)) {
+    ForgetCachedContentVisibility();
+  }
   HandleLastRememberedSize();
   PresContext()->SetNeedsToUpdateHiddenByContentVisibilityForAnimations();
   PresShell()->FrameNeedsReflow(
@@ -7991,7 +8494,75 @@ static nsPoint OffsetCalculator(const nsIFrame* aThis, const nsIFrame* aOther) {
   return offset;
 }
 
+static LazyLogModule sOffsetToRootCacheLog("OffsetToRootCache");
+
+struct nsIFrame::OffsetToRootCache {
+  nsTHashMap<nsPtrHashKey<const nsIFrame>, nsPoint> mOffsets;
+  uint32_t mDepth = 0;
+  uint32_t mHits = 0;
+  uint32_t mMisses = 0;
+};
+
+nsIFrame::OffsetToRootCache* nsIFrame::sOffsetToRootCache = nullptr;
+
+nsIFrame::AutoOffsetToRootCache::AutoOffsetToRootCache() {
+  MOZ_ASSERT(NS_IsMainThread());
+  if (!sOffsetToRootCache) {
+    sOffsetToRootCache = new OffsetToRootCache();
+  }
+  sOffsetToRootCache->mDepth++;
+}
+
+nsIFrame::AutoOffsetToRootCache::~AutoOffsetToRootCache() {
+  MOZ_ASSERT(sOffsetToRootCache);
+  if (--sOffsetToRootCache->mDepth) {
+    return;
+  }
+  MOZ_LOG(sOffsetToRootCacheLog, LogLevel::Debug,
+          ("%u hits, %u misses, %u frames", sOffsetToRootCache->mHits,
+           sOffsetToRootCache->mMisses,
+           sOffsetToRootCache->mOffsets.Count()));
+  delete sOffsetToRootCache;
+  sOffsetToRootCache = nullptr;
+}
+
+void nsIFrame::ForgetCachedOffsetsToRoot() {
+  MOZ_ASSERT(sOffsetToRootCache);
+  sOffsetToRootCache->mOffsets.Clear();
+}
+
+// Returns the sum of the positions of aFrame and all its ancestors in its
+// document, which is what OffsetCalculator computes for it when walking to
+// the root, and remembers it for aFrame and the ancestors we had to walk past.
+nsPoint nsIFrame::CachedOffsetToRoot(const nsIFrame* aFrame) {
+  MOZ_ASSERT(sOffsetToRootCache);
+  auto& offsets = sOffsetToRootCache->mOffsets;
+  AutoTArray<const nsIFrame*, 32> uncached;
+  nsPoint offset;
+  for (const nsIFrame* f = aFrame; f; f = f->GetParent()) {
+    if (auto cached = offsets.Lookup(f)) {
+      offset = cached.Data();
+      break;
+    }
+    uncached.AppendElement(f);
+  }
+  if (uncached.IsEmpty()) {
+    sOffsetToRootCache->mHits++;
+    return offset;
+  }
+  sOffsetToRootCache->mMisses++;
+  for (const nsIFrame* f : Reversed(uncached)) {
+    offset += f->GetPosition();
+    offsets.InsertOrUpdate(f, offset);
+  }
+  return offset;
+}
+
 nsPoint nsIFrame::GetOffsetTo(const nsIFrame* aOther) const {
+  if (sOffsetToRootCache) {
+    MOZ_ASSERT(aOther, "Must have frame for destination coordinate system!");
+    return CachedOffsetToRoot(this) - CachedOffsetToRoot(aOther);
+  }
   return OffsetCalculator<&nsIFrame::GetPosition>(this, aOther);
 }
 
@@ -8017,6 +8588,14 @@ nsPoint nsIFrame::GetOffsetToCrossDoc(const nsIFrame* aOther,
       "trying to get the offset between frames in different document "
       "hierarchies?");
 
+  if (sOffsetToRootCache && aOther->PresContext() == PresContext() &&
+      aAPD == PresContext()->AppUnitsPerDevPixel()) {
+    // Whether or not aOther is our ancestor, everything above our document's
+    // root frame contributes the same to both offsets, and there's no app
+    // units conversion to do.
+    return CachedOffsetToRoot(this) - CachedOffsetToRoot(aOther);
+  }
+
   const nsIFrame* root = nullptr;
   // offset will hold the final offset
   // docOffset holds the currently accumulated offset at the current APD, it
@@ -8122,10 +8701,86 @@ nsIWidget* nsIFrame::GetNearestWidget(nsPoint& aOffset) const {
   return PresContext()->GetRootWidget();
 }
 
+static LazyLogModule sTransformMatrixCacheLog("TransformMatrixCache");
+
+struct nsIFrame::TransformMatrixCache {
+  // What GetTransformMatrix() returned for a frame and one set of arguments.
+  // A frame is nearly always asked with the same arguments, so we don't bother
+  // hashing them.
+  struct Entry {
+    ViewportType mViewportType;
+    RelativeTo mStopAtAncestor;
+    uint32_t mFlags;
+    nsIFrame* mAncestor;
+    Matrix4x4Flagged mMatrix;
+  };
+  nsTHashMap<nsPtrHashKey<const nsIFrame>, AutoTArray<Entry, 1>> mEntries;
+  uint32_t mDepth = 0;
+  uint32_t mHits = 0;
+  uint32_t mMisses = 0;
+};
+
+nsIFrame::TransformMatrixCache* nsIFrame::sTransformMatrixCache = nullptr;
+
+nsIFrame::AutoTransformMatrixCache::AutoTransformMatrixCache() {
+  MOZ_ASSERT(NS_IsMainThread());
+  if (!sTransformMatrixCache) {
+    sTransformMatrixCache = new TransformMatrixCache();
+  }
+  sTransformMatrixCache->mDepth++;
+}
+
+nsIFrame::AutoTransformMatrixCache::~AutoTransformMatrixCache() {
+  MOZ_ASSERT(sTransformMatrixCache);
+  if (--sTransformMatrixCache->mDepth) {
+    return;
+  }
+  MOZ_LOG(sTransformMatrixCacheLog, LogLevel::Debug,
+          ("%u hits, %u misses, %u frames", sTransformMatrixCache->mHits,
+           sTransformMatrixCache->mMisses,
+           sTransformMatrixCache->mEntries.Count()));
+  delete sTransformMatrixCache;
+  sTransformMatrixCache = nullptr;
+}
+
+void nsIFrame::ForgetCachedTransformMatrices() {
+  MOZ_ASSERT(sTransformMatrixCache);
+  sTransformMatrixCache->mEntries.Clear();
+}
+
 Matrix4x4Flagged nsIFrame::GetTransformMatrix(ViewportType aViewportType,
                                               RelativeTo aStopAtAncestor,
                                               nsIFrame** aOutAncestor,
                                               uint32_t aFlags) const {
+  if (!sTransformMatrixCache) {
+    return ComputeTransformMatrix(aViewportType, aStopAtAncestor, aOutAncestor,
+                                  aFlags);
+  }
+
+  auto& entries = sTransformMatrixCache->mEntries.LookupOrInsert(this);
+  for (const auto& entry : entries) {
+    if (entry.mViewportType == aViewportType &&
+        entry.mStopAtAncestor.mFrame == aStopAtAncestor.mFrame &&
+        entry.mStopAtAncestor.mViewportType ==
+            aStopAtAncestor.mViewportType &&
+        entry.mFlags == aFlags) {
+      sTransformMatrixCache->mHits++;
+      *aOutAncestor = entry.mAncestor;
+      return entry.mMatrix;
+    }
+  }
+  sTransformMatrixCache->mMisses++;
+  Matrix4x4Flagged matrix = ComputeTransformMatrix(
+      aViewportType, aStopAtAncestor, aOutAncestor, aFlags);
+  entries.AppendElement(TransformMatrixCache::Entry{
+      aViewportType, aStopAtAncestor, aFlags, *aOutAncestor, matrix});
+  return matrix;
+}
+
+Matrix4x4Flagged nsIFrame::ComputeTransformMatrix(ViewportType aViewportType,
+                                                  RelativeTo aStopAtAncestor,
+                                                  nsIFrame** aOutAncestor,
+                                                  uint32_t aFlags) const {
   MOZ_ASSERT(aOutAncestor, "Need a place to put the ancestor!");
 
   /* If we're transformed, we want to hand back the combination
@@ -8573,6 +9228,12 @@ void nsIFrame::SetPosition(const nsPoint& aPt) {
   if (mRect.TopLeft() == aPt) {
     return;
   }
+  if (MOZ_UNLIKELY(sOffsetToRootCache)) {
+    ForgetCachedOffsetsToRoot();
+  }
+  if (MOZ_UNLIKELY(sTransformMatrixCache)) {
+    ForgetCachedTransformMatrices();
+  }
   mRect.MoveTo(aPt);
   MarkNeedsDisplayItemRebuild();
 }
@@ -9307,11 +9968,15 @@ const nsFrameSelection* nsIFrame::GetConstFrameSelection() const {
 bool nsIFrame::IsFrameSelected() const {
   NS_ASSERTION(!GetContent() || GetContent()->IsMaybeSelected(),
                "use the public IsSelected() instead");
+  // While painting, the pres shell keeps a snapshot of the nodes each
+  // selection fully contains, so that select-all doesn't make every painted
+  // frame binary-search every selection's ranges again.
+  SelectionNodeCache* cache = PresShell()->GetSelectionNodeCache();
   if (const ShadowRoot* shadowRoot =
           GetContent()->GetShadowRootForSelection()) {
-    return shadowRoot->IsSelected(0, shadowRoot->GetChildCount());
+    return shadowRoot->IsSelected(0, shadowRoot->GetChildCount(), cache);
   }
-  return GetContent()->IsSelected(0, GetContent()->GetChildCount());
+  return GetContent()->IsSelected(0, GetContent()->GetChildCount(), cache);
 }
 
 nsresult nsIFrame::GetPointFromOffset(int32_t inOffset, nsPoint* outPoint) {
@@ -10550,6 +11215,11 @@ nsIFrame::SelectablePeekReport nsIFrame::GetFrameFromDirection(
   AutoAssertNoDomMutations guard;
   const nsFrameSelection* frameSelection =
       GetContent() ? GetContent()->GetFrameSelection() : nullptr;
+  // The next frame in either direction is usually on the same line of the
+  // block as the previous one, or on a line after (or, going backwards,
+  // before) it, so start looking for it there rather than at the first line.
+  const nsIFrame* lastBlockFrame = nullptr;
+  int32_t lastLine = 0;
   while (!selectable) {
     auto [blockFrame, lineFrame] = traversedFrame->GetContainingBlockForLine(
         aOptions.contains(PeekOffsetOption::StopAtScroller));
@@ -10558,10 +11228,14 @@ nsIFrame::SelectablePeekReport nsIFrame::GetFrameFromDirection(
     }
 
     nsILineIterator* it = blockFrame->GetLineIterator();
-    int32_t thisLine = it->FindLineContaining(lineFrame);
+    const int32_t hintLine = blockFrame == lastBlockFrame ? lastLine : 0;
+    int32_t thisLine = it->FindLineContainingWithHint(
+        lineFrame, hintLine, aDirection == eDirPrevious);
     if (thisLine < 0) {
       return result;
     }
+    lastBlockFrame = blockFrame;
+    lastLine = thisLine;
 
     bool atLineEdge = MOZ_TRY(
         needsVisualTraversal
@@ -11921,6 +12595,16 @@ void nsIFrame::SetParent(nsContainerFrame* aParent) {
   MOZ_ASSERT_IF(ParentIsWrapperAnonBox(),
                 aParent->Style()->IsInheritingAnonBox());
 
+  if (MOZ_UNLIKELY(sOffsetToRootCache)) {
+    ForgetCachedOffsetsToRoot();
+  }
+  if (MOZ_UNLIKELY(sTransformMatrixCache)) {
+    ForgetCachedTransformMatrices();
+  }
+  if (MOZ_UNLIKELY(sContentVisibilityCache)) {
+    ForgetCachedContentVisibility();
+  }
+
   // Note that the current mParent may already be destroyed at this point.
   mParent = aParent;
   MOZ_ASSERT(!mParent || PresShell() == mParent->PresShell());
@@ -58,11 +58,13 @@
 #include "mozilla/EnumSet.h"
 #include "mozilla/EventForwards.h"
 #include "mozilla/LayoutStructs.h"
+#include "mozilla/Logging.h"
 #include "mozilla/Maybe.h"
 #include "mozilla/ReflowOutput.h"
 #include "mozilla/RelativeTo.h"
 #include "mozilla/Result.h"
 #include "mozilla/SmallPointerArray.h"
+#include "mozilla/Span.h"
 #include "mozilla/ToString.h"
 #include "mozilla/WritingModes.h"
 #include "mozilla/dom/RustTypes.h"
@@ -772,7 +774,8 @@ class nsIFrame : public nsQueryFrame {
         mHasPaddingChange(false),
         mInScrollAnchorChain(false),
         mHasColumnSpanSiblings(false),
-        mDescendantMayDependOnItsStaticPosition(false) {
+        mDescendantMayDependOnItsStaticPosition(false),
+        mApproximateVisibleCount(0) {
     MOZ_ASSERT(mComputedStyle);
     MOZ_ASSERT(mPresContext);
     mozilla::PodZero(&mOverflow);
@@ -1219,6 +1222,14 @@ class nsIFrame : public nsQueryFrame {
     if (aRect == mRect) {
       return;
     }
+    if (MOZ_UNLIKELY(sOffsetToRootCache) &&
+        aRect.TopLeft() != mRect.TopLeft()) {
+      ForgetCachedOffsetsToRoot();
+    }
+    // Transforms depend on our size too, through their reference box.
+    if (MOZ_UNLIKELY(sTransformMatrixCache)) {
+      ForgetCachedTransformMatrices();
+    }
     if (mOverflow.mType != OverflowStorageType::Large &&
         mOverflow.mType != OverflowStorageType::None) {
       mozilla::OverflowAreas overflow = GetOverflowAreas();
@@ -1266,7 +1277,15 @@ class nsIFrame : public nsQueryFrame {
     if (aWritingMode.IsPhysicalRTL()) {
       nscoord oldWidth = mRect.Width();
       SetSize(aSize.GetPhysicalSize(aWritingMode));
-      mRect.x -= mRect.Width() - oldWidth;
+      if (mRect.Width() != oldWidth) {
+        if (MOZ_UNLIKELY(sOffsetToRootCache)) {
+          ForgetCachedOffsetsToRoot();
+        }
+        if (MOZ_UNLIKELY(sTransformMatrixCache)) {
+          ForgetCachedTransformMatrices();
+        }
+        mRect.x -= mRect.Width() - oldWidth;
+      }
     } else {
       SetSize(aSize.GetPhysicalSize(aWritingMode));
     }
@@ -1805,11 +1824,12 @@ class nsIFrame : public nsQueryFrame {
   /// the old image visibility code.
   void UpdateVisibilitySynchronously();
 
-  // A frame property which stores the visibility state of this frame. Right
-  // now that consists of an approximate visibility counter represented as a
-  // uint32_t. When the visibility of this frame is not being tracked, this
-  // property is absent.
-  NS_DECLARE_FRAME_PROPERTY_SMALL_VALUE(VisibilityStateProperty, uint32_t);
+  /// Like UpdateVisibilitySynchronously(), but for many frames at once, e.g.
+  /// all the images a reflow just laid out for the first time. The frames
+  /// share the work of finding their ancestor scroll containers and of
+  /// mapping their rects into them.
+  static void UpdateVisibilitySynchronously(
+      mozilla::Span<nsIFrame* const> aFrames);
 
  protected:
   /**
@@ -3379,6 +3399,22 @@ class nsIFrame : public nsQueryFrame {
    */
   nsPoint GetOffsetTo(const nsIFrame* aOther) const;
 
+  /**
+   * While one of these is alive, GetOffsetTo() and GetOffsetToCrossDoc()
+   * between frames of the same document remember the offset of every frame
+   * they walk past from its document's root frame. Repeated queries for
+   * frames sharing ancestors then don't walk the same parent chains again.
+   *
+   * Moving, reparenting or destroying any frame forgets all of it, but
+   * callers should still only use this around code that doesn't reflow.
+   * These nest, and are main-thread only.
+   */
+  class MOZ_RAII AutoOffsetToRootCache final {
+   public:
+    AutoOffsetToRootCache();
+    ~AutoOffsetToRootCache();
+  };
+
   // GetOffsetTo() to the root of this document.
   nsPoint GetOffsetToRootFrame() const;
 
@@ -3504,6 +3540,21 @@ class nsIFrame : public nsQueryFrame {
       const mozilla::EnumSet<IncludeContentVisibility>& =
           IncludeAllContentVisibility()) const;
 
+  /**
+   * While one of these is alive, GetClosestContentVisibilityAncestor() (and so
+   * IsHiddenByContentVisibilityOnAnyAncestor()) remembers its answer for every
+   * ancestor it walks past, so that queries for many frames sharing ancestors
+   * don't walk the same parent chains again.
+   *
+   * Changing the content-visibility or relevancy of any frame, or reparenting
+   * or destroying one, forgets all of it. These nest, and are main-thread only.
+   */
+  class MOZ_RAII AutoContentVisibilityCache final {
+   public:
+    AutoContentVisibilityCache();
+    ~AutoContentVisibilityCache();
+  };
+
   /**
    * @brief Returns true if the frame is hidden=until-found or in a closed
    *        <details> element.
@@ -3659,6 +3710,22 @@ class nsIFrame : public nsQueryFrame {
                                       nsIFrame** aOutAncestor,
                                       uint32_t aFlags = 0) const;
 
+  /**
+   * While one of these is alive, GetTransformMatrix() remembers what it
+   * returned for each frame and set of arguments, so code that transforms
+   * many rects or points up shared ancestor chains doesn't recompute the same
+   * transforms and perspectives again.
+   *
+   * Moving, resizing, reparenting, restyling or destroying any frame forgets
+   * all of it, but callers should still only use this around code that doesn't
+   * reflow, scroll or zoom. These nest, and are main-thread only.
+   */
+  class MOZ_RAII AutoTransformMatrixCache final {
+   public:
+    AutoTransformMatrixCache();
+    ~AutoTransformMatrixCache();
+  };
+
   /**
    * Return true if this frame's preferred size property or max size property
    * contains a percentage value that should be resolved against zero when
@@ -5299,6 +5366,9 @@ class nsIFrame : public nsQueryFrame {
     NS_ASSERTION(!(mState & NS_FRAME_IN_REFLOW), "frame is already in reflow");
 #endif
     AddStateBits(NS_FRAME_IN_REFLOW);
+    if (MOZ_LOG_TEST(sReflowStatsLog, mozilla::LogLevel::Info)) {
+      RecordReflowStart();
+    }
   }
 
  private:
@@ -5310,6 +5380,39 @@ class nsIFrame : public nsQueryFrame {
    */
   FrameProperties mProperties;
 
+  // The memo of AutoOffsetToRootCache, or null if there's none alive.
+  struct OffsetToRootCache;
+  static OffsetToRootCache* sOffsetToRootCache;
+  static void ForgetCachedOffsetsToRoot();
+  static nsPoint CachedOffsetToRoot(const nsIFrame* aFrame);
+
+  // The memo of AutoContentVisibilityCache, or null if there's none alive.
+  struct ContentVisibilityCache;
+  static ContentVisibilityCache* sContentVisibilityCache;
+  static void ForgetCachedContentVisibility();
+  static nsIFrame* CachedClosestContentHider(
+      nsIFrame* aFrame,
+      const mozilla::EnumSet<IncludeContentVisibility>& aInclude);
+
+  // The memo of AutoTransformMatrixCache, or null if there's none alive.
+  struct TransformMatrixCache;
+  static TransformMatrixCache* sTransformMatrixCache;
+  static void ForgetCachedTransformMatrices();
+  Matrix4x4Flagged ComputeTransformMatrix(mozilla::ViewportType aViewportType,
+                                          mozilla::RelativeTo aStopAtAncestor,
+                                          nsIFrame** aOutAncestor,
+                                          uint32_t aFlags) const;
+
+  // Per-frame-class reflow statistics of the reflow subtree being sampled, or
+  // null if there's none. See the comment above sReflowStatsLog's definition.
+  static mozilla::LazyLogModule sReflowStatsLog;
+  struct ReflowStats;
+  static ReflowStats* sReflowStats;
+  void RecordReflowStart();
+  void RecordReflowEnd();
+  void ForgetReflowStatsFrame();
+  static void DropReflowStats();
+
   // When there is no scrollable overflow area, and the ink overflow area only
   // slightly larger than mRect, the ink overflow area may be stored a set of
   // four 1-byte deltas from the edges of mRect rather than allocating a whole
@@ -5509,6 +5612,13 @@ class nsIFrame : public nsQueryFrame {
    */
   bool mDescendantMayDependOnItsStaticPosition : 1;
 
+  /**
+   * The visibility state of this frame, which consists of an approximate
+   * visibility counter. Only meaningful if NS_FRAME_VISIBILITY_IS_TRACKED is
+   * set.
+   */
+  uint32_t mApproximateVisibleCount;
+
  protected:
   // Helpers
   /**
@@ -6,6 +6,45 @@
 
 #include "nsIFrame.h"
 
+static bool LineContains(nsILineIterator* aIt, int32_t aLineNumber,
+                         const nsIFrame* aFrame) {
+  auto line = aIt->GetLine(aLineNumber);
+  if (line.isErr()) {
+    return false;
+  }
+  nsIFrame* frame = line.inspect().mFirstFrameOnLine;
+  for (int32_t i = line.inspect().mNumFramesOnLine; frame && i > 0;
+       --i, frame = frame->GetNextSibling()) {
+    if (frame == aFrame) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int32_t nsILineIterator::FindLineContainingWithHint(const nsIFrame* aFrame,
+                                                    int32_t aHintLine,
+                                                    bool aBackward) {
+  if (aBackward) {
+    for (int32_t i = aHintLine; i >= 0; --i) {
+      if (LineContains(this, i, aFrame)) {
+        return i;
+      }
+    }
+    return FindLineContaining(aFrame, aHintLine + 1);
+  }
+  int32_t line = FindLineContaining(aFrame, aHintLine);
+  if (line >= 0) {
+    return line;
+  }
+  for (int32_t i = 0; i < aHintLine; ++i) {
+    if (LineContains(this, i, aFrame)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
 namespace mozilla {
 
 void LineFrameFinder::Scan(nsIFrame* aFrame) {
@@ -28,16 +67,14 @@ void LineFrameFinder::Scan(nsIFrame* aFrame) {
     return;
   }
   if (rect.IStart(mWM) < mPos.I(mWM)) {
-    if (!mClosestFromStart ||
-        rect.IEnd(mWM) >
-            mClosestFromStart->GetLogicalRect(mWM, mContainerSize).IEnd(mWM)) {
+    if (!mClosestFromStart || rect.IEnd(mWM) > mClosestFromStartIEnd) {
       mClosestFromStart = aFrame;
+      mClosestFromStartIEnd = rect.IEnd(mWM);
     }
   } else {
-    if (!mClosestFromEnd ||
-        rect.IStart(mWM) <
-            mClosestFromEnd->GetLogicalRect(mWM, mContainerSize).IStart(mWM)) {
+    if (!mClosestFromEnd || rect.IStart(mWM) < mClosestFromEndIStart) {
       mClosestFromEnd = aFrame;
+      mClosestFromEndIStart = rect.IStart(mWM);
     }
   }
 }
@@ -58,12 +95,8 @@ void LineFrameFinder::Finish(nsIFrame** aFrameFound,
   } else if (!mClosestFromEnd) {
     *aFrameFound = mClosestFromStart;
   } else {  // we're between two frames
-    nscoord delta =
-        mClosestFromEnd->GetLogicalRect(mWM, mContainerSize).IStart(mWM) -
-        mClosestFromStart->GetLogicalRect(mWM, mContainerSize).IEnd(mWM);
-    if (mPos.I(mWM) <
-        mClosestFromStart->GetLogicalRect(mWM, mContainerSize).IEnd(mWM) +
-            delta / 2) {
+    nscoord delta = mClosestFromEndIStart - mClosestFromStartIEnd;
+    if (mPos.I(mWM) < mClosestFromStartIEnd + delta / 2) {
       *aFrameFound = mClosestFromStart;
     } else {
       *aFrameFound = mClosestFromEnd;
@@ -74,6 +74,16 @@ class nsILineIterator {
   virtual int32_t FindLineContaining(const nsIFrame* aFrame,
                                      int32_t aStartLine = 0) = 0;
 
+  /**
+   * Like FindLineContaining, but for when aFrame is likely on or near
+   * aHintLine (e.g. the line a neighbouring frame was found on). Looks at
+   * aHintLine and the lines after it first, or, if aBackward, aHintLine and
+   * the lines before it, and only then at the remaining lines, so that no
+   * line is looked at twice.
+   */
+  int32_t FindLineContainingWithHint(const nsIFrame* aFrame, int32_t aHintLine,
+                                     bool aBackward);
+
   // Given a line number and a coordinate, find the frame on the line
   // that is nearest to aPos along the inline axis. (The block-axis coord
   // of aPos is irrelevant.)
@@ -118,6 +128,10 @@ struct LineFrameFinder {
   nsIFrame* mFirstFrame = nullptr;
   nsIFrame* mClosestFromStart = nullptr;
   nsIFrame* mClosestFromEnd = nullptr;
+  // The edges of the above frames facing mPos, so that we don't need to
+  // recompute their logical rects for every frame we compare against them.
+  nscoord mClosestFromStartIEnd = 0;
+  nscoord mClosestFromEndIStart = 0;
 };
 
 }  // namespace mozilla
@@ -20,6 +20,7 @@
 #include "mozilla/PresShell.h"
 #include "mozilla/PresShellInlines.h"
 #include "mozilla/ReflowInput.h"
+#include "mozilla/ScrollContainerFrame.h"
 #include "mozilla/SVGImageContext.h"
 #include "mozilla/StaticPrefs_browser.h"
 #include "mozilla/StaticPrefs_image.h"
@@ -49,6 +50,7 @@
 #include "nsIFrameInlines.h"
 #include "nsIImageLoadingContent.h"
 #include "nsILoadGroup.h"
+#include "nsIReflowCallback.h"
 #include "nsImageLoadingContent.h"
 #include "nsImageMap.h"
 #include "nsImageRenderer.h"
@@ -61,6 +63,7 @@
 #include "nsString.h"
 #include "nsStyleConsts.h"
 #include "nsStyleUtil.h"
+#include "nsTHashMap.h"
 #include "nsTransform2D.h"
 #ifdef ACCESSIBILITY
 #  include "nsAccessibilityService.h"
@@ -99,6 +102,22 @@ using mozilla::layout::TextDrawTarget;
 
 static constexpr wr::ImageKey kNoKey{{0}, 0};
 
+// Counts how often an image notification (size available, load complete,
+// density change) got away without reflowing the frame.
+static LazyLogModule sImageIntrinsicSizeLog("ImageIntrinsicSize");
+
+static void LogIntrinsicSizeUpdate(const char* aOutcome, bool aReflowed) {
+  static uint64_t sUpdates = 0;
+  static uint64_t sSkippedReflows = 0;
+  ++sUpdates;
+  if (!aReflowed) {
+    ++sSkippedReflows;
+  }
+  MOZ_LOG(sImageIntrinsicSizeLog, LogLevel::Debug,
+          ("%s (%" PRIu64 " of %" PRIu64 " updates skipped reflow)", aOutcome,
+           sSkippedReflows, sUpdates));
+}
+
 class nsDisplayGradient final : public nsPaintedDisplayItem {
  public:
   nsDisplayGradient(nsDisplayListBuilder* aBuilder, nsImageFrame* aFrame)
@@ -510,11 +529,6 @@ void nsImageFrame::DisconnectMap() {
 void nsImageFrame::Destroy(DestroyContext& aContext) {
   MaybeSendIntrinsicSizeAndRatioToEmbedder(Nothing(), Nothing());
 
-  if (mReflowCallbackPosted) {
-    PresShell()->CancelReflowCallback(this);
-    mReflowCallbackPosted = false;
-  }
-
   // Tell our image map, if there is one, to clean up
   // This causes the nsImageMap to unregister itself as
   // a DOM listener.
@@ -1366,6 +1380,12 @@ void nsImageFrame::UpdateIntrinsicSizeAndRatio() {
   }();
 
   if (!intrinsicSizeOrRatioChanged) {
+    // Progressive and multipart images notify repeatedly with the same
+    // dimensions. Our layout can't have changed, so whatever repaint the
+    // notification needs is up to the caller.
+    if (MOZ_LOG_TEST(sImageIntrinsicSizeLog, LogLevel::Debug)) {
+      LogIntrinsicSizeUpdate("unchanged", false);
+    }
     return;
   }
 
@@ -1380,9 +1400,21 @@ void nsImageFrame::UpdateIntrinsicSizeAndRatio() {
   // Now we need to reflow if we have an unconstrained size and have
   // already gotten the initial reflow.
   if (!HasAnyStateBits(IMAGE_SIZECONSTRAINED)) {
+    if (MOZ_LOG_TEST(sImageIntrinsicSizeLog, LogLevel::Debug)) {
+      LogIntrinsicSizeUpdate("reflow", true);
+    }
     PresShell()->FrameNeedsReflow(
         this, IntrinsicDirty::FrameAncestorsAndDescendants, NS_FRAME_IS_DIRTY);
-  } else if (PresShell()->IsActive()) {
+    return;
+  }
+
+  // Our box doesn't depend on the intrinsic size, but the dest rect within it
+  // (object-fit / object-position) does, so a repaint is all we need.
+  if (MOZ_LOG_TEST(sImageIntrinsicSizeLog, LogLevel::Debug)) {
+    LogIntrinsicSizeUpdate("size-constrained", false);
+  }
+  InvalidateFrame();
+  if (PresShell()->IsActive()) {
     // We've already gotten the initial reflow, and our size hasn't changed,
     // so we're ready to request a decode.
     MaybeDecodeForPredictedSize();
@@ -1401,26 +1433,78 @@ void nsImageFrame::NotifyNewCurrentRequest(imgIRequest* aRequest) {
   UpdateImage(aRequest, image);
 }
 
-void nsImageFrame::MaybeDecodeForPredictedSize() {
-  // Check that we're ready to decode.
-  if (!mImage) {
-    return;  // Nothing to do yet.
+// The flags we decode for our predicted size with.
+static constexpr uint32_t kPredictedSizeDecodeFlags =
+    imgIContainer::FLAG_HIGH_QUALITY_SCALING | imgIContainer::FLAG_ASYNC_NOTIFY;
+
+/**
+ * Collects the image frames of a pres shell that reflowed and want their
+ * visibility updated or to decode for their predicted size, and does all of
+ * that once the reflow is finished.
+ *
+ * Updating the visibility of all the frames at once lets them share the
+ * walks to their ancestor scroll containers. For the decodes, this lets the
+ * frames that share a reference frame share the scale to the screen, too, and
+ * lets us request the decodes of the images closest to the viewport first.
+ *
+ * Owned by the pres shell's root frame, see PostReflowBatchProperty.
+ */
+class nsImageFrame::PostReflowBatch final : public nsIReflowCallback {
+ public:
+  explicit PostReflowBatch(mozilla::PresShell* aPresShell)
+      : mPresShell(aPresShell) {}
+
+  ~PostReflowBatch() {
+    if (mReflowCallbackPosted) {
+      mPresShell->CancelReflowCallback(this);
+    }
   }
 
-  if (mComputedSize.IsEmpty()) {
-    return;  // We won't draw anything, so no point in decoding.
+  void AddVisibilityUpdate(nsImageFrame* aFrame) {
+    mVisibilityUpdates.AppendElement(aFrame);
+    EnsureReflowCallbackPosted();
   }
 
-  if (GetVisibility() != Visibility::ApproximatelyVisible) {
-    return;  // We're not visible, so don't decode.
+  void AddPredictedSizeDecode(nsImageFrame* aFrame) {
+    mDecodes.AppendElement(aFrame);
+    EnsureReflowCallbackPosted();
   }
 
-  // OK, we're ready to decode. Compute the scale to the screen...
-  mozilla::PresShell* presShell = PresShell();
+  LayoutDeviceToScreenScale2D ScaleToScreen(nsIFrame* aReferenceFrame,
+                                            nsImageFrame* aFrame);
+
+  bool ReflowFinished() override;
+  void ReflowCallbackCanceled() override;
+
+ private:
+  void EnsureReflowCallbackPosted() {
+    if (!mReflowCallbackPosted) {
+      mReflowCallbackPosted = true;
+      mPresShell->PostReflowCallback(this);
+    }
+  }
+
+  void UpdateVisibilities();
+
+  mozilla::PresShell* const mPresShell;
+  nsTArray<WeakFrame> mVisibilityUpdates;
+  nsTArray<WeakFrame> mDecodes;
+  // The scale to the screen of the frames under each reference frame, only
+  // valid while we're flushing.
+  nsTHashMap<nsPtrHashKey<nsIFrame>, LayoutDeviceToScreenScale2D> mScales;
+  bool mReflowCallbackPosted = false;
+};
+
+NS_DECLARE_FRAME_PROPERTY_DELETABLE(PostReflowBatchProperty,
+                                    nsImageFrame::PostReflowBatch)
+
+// Computes the scale to the screen of the content of aFrame.
+static LayoutDeviceToScreenScale2D ComputeScaleToScreen(nsIFrame* aFrame) {
+  mozilla::PresShell* presShell = aFrame->PresShell();
   MatrixScales scale =
       ScaleFactor<UnknownUnits, UnknownUnits>(
           presShell->GetCumulativeResolution()) *
-      nsLayoutUtils::GetTransformToAncestorScaleExcludingAnimated(this);
+      nsLayoutUtils::GetTransformToAncestorScaleExcludingAnimated(aFrame);
   auto resolutionToScreen = ViewAs<LayoutDeviceToScreenScale2D>(scale);
 
   // If we are in a remote browser, then apply scaling from ancestor browsers
@@ -1429,10 +1513,202 @@ void nsImageFrame::MaybeDecodeForPredictedSize() {
         resolutionToScreen * ViewAs<ScreenToScreenScale2D>(
                                  browserChild->GetEffectsInfo().mRasterScale);
   }
+  return resolutionToScreen;
+}
+
+LayoutDeviceToScreenScale2D nsImageFrame::PostReflowBatch::ScaleToScreen(
+    nsIFrame* aReferenceFrame, nsImageFrame* aFrame) {
+  // A frame that isn't its own reference frame isn't transformed, so the only
+  // thing between it and its reference frame is a translation, which doesn't
+  // affect the scale. A transformed frame gets its own entry.
+  return mScales.LookupOrInsertWith(
+      aReferenceFrame, [&] { return ComputeScaleToScreen(aFrame); });
+}
+
+// Returns how far aRect is from aVisibleRect, in app units along each axis.
+static nscoord DistanceFromRect(const nsRect& aRect,
+                                const nsRect& aVisibleRect) {
+  const nscoord dx = std::max({aVisibleRect.x - aRect.XMost(),
+                               aRect.x - aVisibleRect.XMost(), nscoord(0)});
+  const nscoord dy = std::max({aVisibleRect.y - aRect.YMost(),
+                               aRect.y - aVisibleRect.YMost(), nscoord(0)});
+  return dx + dy;
+}
+
+void nsImageFrame::PostReflowBatch::UpdateVisibilities() {
+  const nsTArray<WeakFrame> updates = std::move(mVisibilityUpdates);
+  AutoTArray<nsIFrame*, 16> frames;
+  frames.SetCapacity(updates.Length());
+  for (const WeakFrame& weakFrame : updates) {
+    if (auto* frame = static_cast<nsImageFrame*>(weakFrame.GetFrame())) {
+      frame->mVisibilityUpdateQueued = false;
+      frames.AppendElement(frame);
+    }
+  }
+
+  // XXX(seth): We don't need this. The purpose of updating visibility
+  // synchronously is to ensure that animated images start animating
+  // immediately. In the short term, however,
+  // nsImageLoadingContent::OnUnlockedDraw() is enough to ensure that
+  // animations start as soon as the image is painted for the first time, and in
+  // the long term we want to update visibility information from the display
+  // list whenever we paint, so we don't actually need to do this. However, to
+  // avoid behavior changes during the transition from the old image visibility
+  // code, we'll leave it in for now.
+  nsIFrame::UpdateVisibilitySynchronously(frames);
+}
+
+bool nsImageFrame::PostReflowBatch::ReflowFinished() {
+  mReflowCallbackPosted = false;
+
+  // Update the visibilities first, since we only decode for visible frames.
+  // Note that frames becoming visible may already decode from
+  // OnVisibilityChange, in which case they'll just request the same decode
+  // again below.
+  if (!mVisibilityUpdates.IsEmpty()) {
+    UpdateVisibilities();
+  }
+  const nsTArray<WeakFrame> frames = std::move(mDecodes);
+
+  // Use the root scroll container's scrolled area as the viewport when
+  // ordering the decodes, which is good enough to get the images on the screen
+  // decoded before the ones further down the page.
+  nsIFrame* scrolledFrame = nullptr;
+  nsRect visibleRect;
+  if (ScrollContainerFrame* sf = mPresShell->GetRootScrollContainerFrame()) {
+    scrolledFrame = sf->GetScrolledFrame();
+    visibleRect =
+        nsRect(sf->GetScrollPosition(), sf->GetScrollPortRect().Size());
+  }
+
+  // Nothing reflows while we flush, and most of the frames share ancestors.
+  AutoOffsetToRootCache offsetCache;
+
+  struct Decode {
+    nsCOMPtr<imgIContainer> mImage;
+    nsIntSize mSize;
+    nscoord mDistance;
+  };
+  AutoTArray<Decode, 16> decodes;
+  for (const WeakFrame& weakFrame : frames) {
+    auto* frame = static_cast<nsImageFrame*>(weakFrame.GetFrame());
+    if (!frame) {
+      continue;
+    }
+    frame->mPredictedSizeDecodeQueued = false;
+    Maybe<nsIntSize> size = frame->PredictDecodeSize(this);
+    if (!size) {
+      continue;
+    }
+    const nscoord distance =
+        scrolledFrame
+            ? DistanceFromRect(
+                  nsRect(frame->GetOffsetToCrossDoc(scrolledFrame),
+                         frame->GetSize()),
+                  visibleRect)
+            : 0;
+    decodes.AppendElement(Decode{frame->mImage, *size, distance});
+  }
+  mScales.Clear();
+
+  decodes.StableSort([](const Decode& aA, const Decode& aB) {
+    return aA.mDistance < aB.mDistance   ? -1
+           : aA.mDistance > aB.mDistance ? 1
+                                         : 0;
+  });
+  for (const Decode& decode : decodes) {
+    decode.mImage->RequestDecodeForSize(decode.mSize,
+                                        kPredictedSizeDecodeFlags);
+  }
+  return false;
+}
+
+void nsImageFrame::PostReflowBatch::ReflowCallbackCanceled() {
+  mReflowCallbackPosted = false;
+  for (const WeakFrame& weakFrame : mVisibilityUpdates) {
+    if (auto* frame = static_cast<nsImageFrame*>(weakFrame.GetFrame())) {
+      frame->mVisibilityUpdateQueued = false;
+    }
+  }
+  for (const WeakFrame& weakFrame : mDecodes) {
+    if (auto* frame = static_cast<nsImageFrame*>(weakFrame.GetFrame())) {
+      frame->mPredictedSizeDecodeQueued = false;
+    }
+  }
+  mVisibilityUpdates.Clear();
+  mDecodes.Clear();
+}
+
+void nsImageFrame::MaybeDecodeForPredictedSize() {
+  if (Maybe<nsIntSize> size = PredictDecodeSize()) {
+    // Request a decode.
+    mImage->RequestDecodeForSize(*size, kPredictedSizeDecodeFlags);
+  }
+}
+
+static nsImageFrame::PostReflowBatch* GetPostReflowBatch(nsIFrame* aRootFrame) {
+  nsImageFrame::PostReflowBatch* batch =
+      aRootFrame->GetProperty(PostReflowBatchProperty());
+  if (!batch) {
+    batch = new nsImageFrame::PostReflowBatch(aRootFrame->PresShell());
+    aRootFrame->AddProperty(PostReflowBatchProperty(), batch);
+  }
+  return batch;
+}
+
+void nsImageFrame::QueueDecodeForPredictedSize() {
+  if (mPredictedSizeDecodeQueued) {
+    return;
+  }
+  nsIFrame* rootFrame = PresShell()->GetRootFrame();
+  if (!rootFrame) {
+    MaybeDecodeForPredictedSize();
+    return;
+  }
+  // Cheap early-outs, so that we don't queue frames that won't decode anyway.
+  // PredictDecodeSize checks them again when the batch is flushed.
+  if (!mImage || mComputedSize.IsEmpty()) {
+    return;
+  }
+  mPredictedSizeDecodeQueued = true;
+  GetPostReflowBatch(rootFrame)->AddPredictedSizeDecode(this);
+}
+
+void nsImageFrame::QueueVisibilityUpdate() {
+  if (mVisibilityUpdateQueued) {
+    return;
+  }
+  nsIFrame* rootFrame = PresShell()->GetRootFrame();
+  if (!rootFrame) {
+    UpdateVisibilitySynchronously();
+    return;
+  }
+  mVisibilityUpdateQueued = true;
+  GetPostReflowBatch(rootFrame)->AddVisibilityUpdate(this);
+}
+
+Maybe<nsIntSize> nsImageFrame::PredictDecodeSize(PostReflowBatch* aBatch) {
+  // Check that we're ready to decode.
+  if (!mImage) {
+    return Nothing();  // Nothing to do yet.
+  }
+
+  if (mComputedSize.IsEmpty()) {
+    return Nothing();  // We won't draw anything, so no point in decoding.
+  }
+
+  if (GetVisibility() != Visibility::ApproximatelyVisible) {
+    return Nothing();  // We're not visible, so don't decode.
+  }
+
+  // OK, we're ready to decode. Compute the scale to the screen...
+  nsIFrame* referenceFrame = nsLayoutUtils::GetReferenceFrame(this);
+  const LayoutDeviceToScreenScale2D resolutionToScreen =
+      aBatch ? aBatch->ScaleToScreen(referenceFrame, this)
+             : ComputeScaleToScreen(this);
 
   // ...and this frame's content box...
-  const nsPoint offset =
-      GetOffsetToCrossDoc(nsLayoutUtils::GetReferenceFrame(this));
+  const nsPoint offset = GetOffsetToCrossDoc(referenceFrame);
   const nsRect frameContentBox = GetContentRectRelativeToSelf() + offset;
 
   // ...and our predicted dest rect...
@@ -1445,22 +1721,17 @@ void nsImageFrame::MaybeDecodeForPredictedSize() {
   const ScreenIntSize predictedScreenIntSize =
       RoundedToInt(predictedScreenSize);
   if (predictedScreenIntSize.IsEmpty()) {
-    return;
+    return Nothing();
   }
 
   // Determine the optimal image size to use.
-  uint32_t flags = imgIContainer::FLAG_HIGH_QUALITY_SCALING |
-                   imgIContainer::FLAG_ASYNC_NOTIFY;
   SamplingFilter samplingFilter =
       nsLayoutUtils::GetSamplingFilterForFrame(this);
   gfxSize gfxPredictedScreenSize =
       gfxSize(predictedScreenIntSize.width, predictedScreenIntSize.height);
-  nsIntSize predictedImageSize = mImage->OptimalImageSizeForDest(
+  return Some(mImage->OptimalImageSizeForDest(
       gfxPredictedScreenSize, imgIContainer::FRAME_CURRENT, samplingFilter,
-      flags);
-
-  // Request a decode.
-  mImage->RequestDecodeForSize(predictedImageSize, flags);
+      kPredictedSizeDecodeFlags));
 }
 
 nsRect nsImageFrame::GetDestRect(const nsRect& aFrameContentBox,
@@ -1658,8 +1929,8 @@ void nsImageFrame::Reflow(nsPresContext* aPresContext, ReflowOutput& aMetrics,
     }
     if (PresShell()->IsActive()) {
       // We've just reflowed and we should have an accurate size, so we're ready
-      // to request a decode.
-      MaybeDecodeForPredictedSize();
+      // to request a decode, once the rest of the reflow is done.
+      QueueDecodeForPredictedSize();
     }
   }
   FinishAndStoreOverflow(&aMetrics, aReflowInput.mStyleDisplay);
@@ -1667,34 +1938,14 @@ void nsImageFrame::Reflow(nsPresContext* aPresContext, ReflowOutput& aMetrics,
   // Reflow the child frames. Our children can't affect our size in any way.
   ReflowChildren(aPresContext, aReflowInput, aMetrics.Size(GetWritingMode()));
 
-  if (HasAnyStateBits(NS_FRAME_FIRST_REFLOW) && !mReflowCallbackPosted) {
-    mReflowCallbackPosted = true;
-    PresShell()->PostReflowCallback(this);
+  if (HasAnyStateBits(NS_FRAME_FIRST_REFLOW)) {
+    QueueVisibilityUpdate();
   }
 
   NS_FRAME_TRACE(NS_FRAME_TRACE_CALLS, ("exit nsImageFrame::Reflow: size=%d,%d",
                                         aMetrics.Width(), aMetrics.Height()));
 }
 
-bool nsImageFrame::ReflowFinished() {
-  mReflowCallbackPosted = false;
-
-  // XXX(seth): We don't need this. The purpose of updating visibility
-  // synchronously is to ensure that animated images start animating
-  // immediately. In the short term, however,
-  // nsImageLoadingContent::OnUnlockedDraw() is enough to ensure that
-  // animations start as soon as the image is painted for the first time, and in
-  // the long term we want to update visibility information from the display
-  // list whenever we paint, so we don't actually need to do this. However, to
-  // avoid behavior changes during the transition from the old image visibility
-  // code, we'll leave it in for now.
-  UpdateVisibilitySynchronously();
-
-  return false;
-}
-
-void nsImageFrame::ReflowCallbackCanceled() { mReflowCallbackPosted = false; }
-
 // Computes the width of the specified string. aMaxWidth specifies the maximum
 // width available. Once this limit is reached no more characters are measured.
 // The number of characters that fit within the maximum width are returned in
@@ -1757,6 +2008,46 @@ nscoord nsImageFrame::MeasureString(const char16_t* aString, int32_t aLength,
   return totalWidth;
 }
 
+// The lines DisplayAltText broke our alt text into the last time it painted
+// it. They only depend on the text, the font metrics and the inline size we
+// painted it with, so painting the alt feedback again while scrolling doesn't
+// need to measure every word again.
+struct AltTextLines {
+  struct Line {
+    // The number of characters on the line, and the width they take.
+    uint32_t mLength;
+    nscoord mWidth;
+  };
+
+  struct Key {
+    RefPtr<nsFontMetrics> mFontMetrics;
+    nscoord mISize = 0;
+    StyleTextOrientation mTextOrientation = StyleTextOrientation::Mixed;
+    bool mVertical = false;
+    bool mBidiEnabled = false;
+
+    bool operator==(const Key&) const = default;
+  };
+
+  // Forgets the lines we have unless they're for aText and aKey.
+  void Update(const nsString& aText, Key&& aKey) {
+    if (mKey == aKey && mText == aText) {
+      return;
+    }
+    mText = aText;
+    mKey = std::move(aKey);
+    mLines.Clear();
+  }
+
+  nsString mText;
+  Key mKey;
+  // The lines we've measured so far. We only measure as many as fit in the
+  // rect we paint into.
+  nsTArray<Line> mLines;
+};
+
+NS_DECLARE_FRAME_PROPERTY_DELETABLE(AltTextLinesProperty, AltTextLines)
+
 // Formats the alt-text to fit within the specified rectangle. Breaks lines
 // between words if a word would extend past the edge of the rectangle
 void nsImageFrame::DisplayAltText(nsPresContext* aPresContext,
@@ -1795,6 +2086,12 @@ void nsImageFrame::DisplayAltText(nsPresContext* aPresContext,
     aPresContext->SetBidiEnabled();
   }
 
+  AltTextLines* lines = GetOrCreateDeletableProperty(AltTextLinesProperty());
+  lines->Update(aAltText,
+                {fm, iSize, StyleVisibility()->mTextOrientation, isVertical,
+                 aPresContext->BidiEnabled()});
+  size_t lineIndex = 0;
+
   // Always show the first line, even if we have to clip it below
   bool firstLine = true;
   while (strLen > 0) {
@@ -1807,10 +2104,17 @@ void nsImageFrame::DisplayAltText(nsPresContext* aPresContext,
       }
     }
 
-    // Determine how much of the text to display on this line
-    uint32_t maxFit;  // number of characters that fit
-    nscoord strWidth =
-        MeasureString(str, strLen, iSize, maxFit, aRenderingContext, *fm);
+    // Determine how much of the text to display on this line, unless we did
+    // already.
+    if (lineIndex == lines->mLines.Length()) {
+      uint32_t maxFit;  // number of characters that fit
+      nscoord strWidth =
+          MeasureString(str, strLen, iSize, maxFit, aRenderingContext, *fm);
+      lines->mLines.AppendElement(AltTextLines::Line{maxFit, strWidth});
+    }
+    const uint32_t maxFit = lines->mLines[lineIndex].mLength;
+    const nscoord strWidth = lines->mLines[lineIndex].mWidth;
+    lineIndex++;
 
     // Display the text
     nsresult rv = NS_ERROR_FAILURE;
@@ -2122,18 +2426,26 @@ ImgDrawResult nsImageFrame::DisplayAltFeedbackWithoutLayer(
 
   AutoSaveRestore autoSaveRestore(aBuilder, textDrawResult);
 
-  // Paint the border
+  // Paint the border. This is the same recessed border DisplayAltFeedback
+  // paints with nsRecessedBorder, but since it's a plain inset border we can
+  // push it directly, without building a style struct and a border renderer
+  // for each of what may be thousands of images waiting to load.
   if (!isLoading) {
-    nsRecessedBorder recessedBorder(borderEdgeWidth);
-    // Assert that we're not drawing a border-image here; if we were, we
-    // couldn't ignore the ImgDrawResult that PaintBorderWithStyleBorder
-    // returns.
-    MOZ_ASSERT(recessedBorder.mBorderImageSource.IsNone());
-
-    nsRect rect = nsRect(aPt, GetSize());
-    (void)nsCSSRendering::CreateWebRenderCommandsForBorderWithStyleBorder(
-        aItem, this, rect, aBuilder, aResources, aSc, aManager,
-        aDisplayListBuilder, recessedBorder);
+    const int32_t factor = PresContext()->AppUnitsPerDevPixel();
+    const auto borderRect =
+        wr::ToLayoutRect(LayoutDeviceRect::FromAppUnits(
+                             nsRect(aPt, GetSize()), factor)
+                             .Round());
+    // nsRecessedBorder sets its widths directly, without nsStyleBorder's
+    // snapping to device pixels, so don't snap here either.
+    const float borderWidth = NSAppUnitsToFloatPixels(borderEdgeWidth, factor);
+    const wr::BorderSide side = {wr::ColorF{0.0f, 0.0f, 0.0f, 1.0f},
+                                 wr::BorderStyle::Inset};
+    const wr::BorderSide sides[4] = {side, side, side, side};
+    aBuilder.PushBorder(
+        borderRect, borderRect, !aItem->BackfaceIsHidden(),
+        wr::ToBorderWidths(borderWidth, borderWidth, borderWidth, borderWidth),
+        Range<const wr::BorderSide>(sides, 4), wr::EmptyBorderRadius());
   }
 
   // Adjust the inner rect to account for the one pixel recessed border,
@@ -14,7 +14,6 @@
 #include "nsAtomicContainerFrame.h"
 #include "nsDisplayList.h"
 #include "nsIObserver.h"
-#include "nsIReflowCallback.h"
 #include "nsTObserverArray.h"
 
 class nsFontMetrics;
@@ -51,7 +50,7 @@ class nsImageListener final : public imgINotificationObserver {
   nsImageFrame* mFrame;
 };
 
-class nsImageFrame : public nsAtomicContainerFrame, public nsIReflowCallback {
+class nsImageFrame : public nsAtomicContainerFrame {
  public:
   template <typename T>
   using Maybe = mozilla::Maybe<T>;
@@ -179,10 +178,6 @@ class nsImageFrame : public nsAtomicContainerFrame, public nsIReflowCallback {
 
   void DisconnectMap();
 
-  // nsIReflowCallback
-  bool ReflowFinished() final;
-  void ReflowCallbackCanceled() final;
-
   // The kind of image frame we are.
   enum class Kind : uint8_t {
     // For an nsImageLoadingContent.
@@ -230,6 +225,10 @@ class nsImageFrame : public nsAtomicContainerFrame, public nsIReflowCallback {
   void ReflowChildren(nsPresContext*, const ReflowInput&,
                       const mozilla::LogicalSize& aImageSize);
 
+  /**
+   * Recomputes mIntrinsicSize and mIntrinsicRatio, and reflows (or, if our
+   * size doesn't depend on them, repaints) only if either of them changed.
+   */
   void UpdateIntrinsicSizeAndRatio();
 
  protected:
@@ -299,7 +298,31 @@ class nsImageFrame : public nsAtomicContainerFrame, public nsIReflowCallback {
    */
   void MaybeDecodeForPredictedSize();
 
+  /**
+   * Like MaybeDecodeForPredictedSize, but when called during a reflow, defers
+   * the decode until the reflow is finished, so that the decodes of all the
+   * images reflowed together can be requested as a single batch.
+   */
+  void QueueDecodeForPredictedSize();
+
+  /**
+   * Updates our visibility synchronously once the current reflow is done.
+   */
+  void QueueVisibilityUpdate();
+
+  // The work queued by QueueDecodeForPredictedSize and QueueVisibilityUpdate
+  // during a reflow.
+  class PostReflowBatch;
+
  protected:
+  /**
+   * Computes the size we'd like mImage decoded at if we're ready to decode, as
+   * described in MaybeDecodeForPredictedSize. If aBatch is non-null, the scale
+   * to the screen is shared with the other frames of the batch.
+   */
+  mozilla::Maybe<nsIntSize> PredictDecodeSize(
+      PostReflowBatch* aBatch = nullptr);
+
   friend class nsImageListener;
   friend class nsImageLoadingContent;
   friend class mozilla::PresShell;
@@ -423,7 +446,8 @@ class nsImageFrame : public nsAtomicContainerFrame, public nsIReflowCallback {
   bool mOwnedRequestRegistered = false;
   bool mDisplayingIcon = false;
   bool mFirstFrameComplete = false;
-  bool mReflowCallbackPosted = false;
+  bool mVisibilityUpdateQueued = false;
+  bool mPredictedSizeDecodeQueued = false;
   bool mForceSyncDecoding = false;
   bool mIsInObjectOrEmbed = false;
 
@@ -76,6 +76,26 @@ void nsInlineFrame::InvalidateFrameWithRect(const nsRect& aRect,
 
 /* virtual */
 bool nsInlineFrame::IsSelfEmpty() {
+  if (mSelfEmptyState == SelfEmptyState::Unknown) {
+    mSelfEmptyState = ComputeIsSelfEmpty() ? SelfEmptyState::Empty
+                                           : SelfEmptyState::NotEmpty;
+  }
+  MOZ_ASSERT((mSelfEmptyState == SelfEmptyState::Empty) == ComputeIsSelfEmpty(),
+             "Missing invalidation of the cached IsSelfEmpty() result");
+  return mSelfEmptyState == SelfEmptyState::Empty;
+}
+
+void nsInlineFrame::DidSetComputedStyle(ComputedStyle* aOldStyle) {
+  nsContainerFrame::DidSetComputedStyle(aOldStyle);
+  mSelfEmptyState = SelfEmptyState::Unknown;
+  mHasNoBoxDecorations = !StyleDisplay()->HasAppearance() &&
+                         StyleBackground()->IsTransparent(this) &&
+                         !StyleBorder()->HasBorder() &&
+                         StyleEffects()->mBoxShadow.IsEmpty() &&
+                         !StyleOutline()->ShouldPaintOutline();
+}
+
+bool nsInlineFrame::ComputeIsSelfEmpty() {
 #if 0
   // I used to think inline frames worked this way, but it seems they
   // don't.  At least not in our codebase.
@@ -231,7 +251,20 @@ void nsInlineFrame::StealFrame(nsIFrame* aChild) {
 
 void nsInlineFrame::BuildDisplayList(nsDisplayListBuilder* aBuilder,
                                      const nsDisplayListSet& aLists) {
-  BuildDisplayListForInline(aBuilder, aLists);
+  if (mHasNoBoxDecorations && !aBuilder->IsForEventDelivery()) {
+    // Rich-text editors produce lots of wrapper spans with nothing to paint of
+    // their own. DisplayBorderBackgroundOutline would find nothing to add for
+    // them except for the compositor hit-test info, so skip straight to that
+    // and our children.
+    if (IsVisibleForPainting()) {
+      aBuilder->BuildCompositorHitTestInfoIfNeeded(this,
+                                                   aLists.BorderBackground());
+    }
+    BuildDisplayListForNonBlockChildren(aBuilder, aLists,
+                                        DisplayChildFlag::Inline);
+  } else {
+    BuildDisplayListForInline(aBuilder, aLists);
+  }
 
   // The sole purpose of this is to trigger display of the selection
   // window for Named Anchors, which don't have any children and
@@ -1029,6 +1062,44 @@ nsIFrame* nsFirstLineFrame::PullOneFrame(nsPresContext* aPresContext,
   return frame;
 }
 
+void nsFirstLineFrame::PullAllFrames(nsPresContext* aPresContext,
+                                     InlineReflowInput& irs) {
+  MOZ_ASSERT(!GetPrevInFlow(), "Only the first-line frame pulls everything");
+  // Unlike PullOneFrame, move each next-in-flow's frames over as a whole, so
+  // that un-breaking a long inline run doesn't cost a list operation and a
+  // float reparenting walk per child.
+  bool pulledAny = false;
+  for (nsInlineFrame* nextInFlow = irs.mNextInFlow; nextInFlow;
+       nextInFlow = static_cast<nsInlineFrame*>(nextInFlow->GetNextInFlow())) {
+    // The next-in-flow's overflow frames follow its principal ones.
+    AutoFrameListPtr overflowFrames(aPresContext,
+                                    nextInFlow->StealOverflowFrames());
+    if (overflowFrames) {
+      nextInFlow->mFrames.AppendFrames(nullptr, std::move(*overflowFrames));
+    }
+    if (nextInFlow->mFrames.IsEmpty()) {
+      continue;
+    }
+    // See the comment in nsInlineFrame::PullOneFrame. The frames need to be
+    // on a child list for this, so do it before moving them.
+    if (irs.mLineContainer && irs.mLineContainer->GetNextContinuation()) {
+      ReparentFloatsForInlineChild(irs.mLineContainer,
+                                   nextInFlow->mFrames.FirstChild(), true);
+    }
+    const nsFrameList::Slice& newFrames = mFrames.InsertFrames(
+        this, mFrames.LastChild(), std::move(nextInFlow->mFrames));
+    // We are a first-line frame. Fixup the child frames style-context that we
+    // just pulled.
+    ReparentChildListStyle(aPresContext, newFrames, this);
+    pulledAny = true;
+  }
+  irs.mNextInFlow = nullptr;
+  if (pulledAny && irs.mLineLayout) {
+    irs.mLineLayout->SetDirtyNextLine();
+  }
+  MOZ_ASSERT(!HasFramesToPull(static_cast<nsInlineFrame*>(GetNextInFlow())));
+}
+
 void nsFirstLineFrame::Reflow(nsPresContext* aPresContext,
                               ReflowOutput& aReflowOutput,
                               const ReflowInput& aReflowInput,
@@ -1077,15 +1148,7 @@ void nsFirstLineFrame::Reflow(nsPresContext* aPresContext,
     // the right style.
     //
     // All of this is so that text-runs reflow properly.
-    irs.mPrevFrame = mFrames.LastChild();
-    for (;;) {
-      nsIFrame* frame = PullOneFrame(aPresContext, irs);
-      if (!frame) {
-        break;
-      }
-      irs.mPrevFrame = frame;
-    }
-    irs.mPrevFrame = nullptr;
+    PullAllFrames(aPresContext, irs);
   }
 
   NS_ASSERTION(!aReflowInput.mLineLayout->GetInFirstLine(),
@@ -48,6 +48,7 @@ class nsInlineFrame : public nsContainerFrame {
 
   bool IsEmpty() override;
   bool IsSelfEmpty() override;
+  void DidSetComputedStyle(ComputedStyle* aOldStyle) override;
 
   nscoord GetCaretBaseline() const override;
 
@@ -175,8 +176,21 @@ class nsInlineFrame : public nsContainerFrame {
    */
   bool DrainSelfOverflowListInternal(bool aInFirstLine);
 
+  bool ComputeIsSelfEmpty();
+
  protected:
   nscoord mBaseline;
+
+ private:
+  // IsSelfEmpty() only depends on our style and our {ib}-split siblings (which
+  // can't change without reframing us), but line layout and margin collapsing
+  // ask for it over and over, so cache it until our style changes.
+  enum class SelfEmptyState : uint8_t { Unknown, Empty, NotEmpty };
+  SelfEmptyState mSelfEmptyState = SelfEmptyState::Unknown;
+  // Whether our style gives us nothing to paint of our own (no background,
+  // border, box-shadow or outline), so that BuildDisplayList can go straight
+  // to our children. Updated in DidSetComputedStyle.
+  bool mHasNoBoxDecorations = false;
 };
 
 //----------------------------------------------------------------------
@@ -210,6 +224,10 @@ class nsFirstLineFrame final : public nsInlineFrame {
       : nsInlineFrame(aStyle, aPresContext, kClassID) {}
 
   nsIFrame* PullOneFrame(nsPresContext*, InlineReflowInput&) override;
+
+  // Pulls all the frames of all our next-in-flows, appending them to our
+  // principal child list.
+  void PullAllFrames(nsPresContext*, InlineReflowInput&);
 };
 
 #endif /* nsInlineFrame_h_ */
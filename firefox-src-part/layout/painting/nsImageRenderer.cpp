@@ -16,9 +16,11 @@
 #include "gfxContext.h"
 #include "gfxDrawable.h"
 #include "mozilla/ISVGDisplayableFrame.h"
+#include "mozilla/PresShell.h"
 #include "mozilla/SVGIntegrationUtils.h"
 #include "mozilla/SVGObserverUtils.h"
 #include "mozilla/SVGPaintServerFrame.h"
+#include "mozilla/ScrollContainerFrame.h"
 #include "mozilla/StaticPrefs_image.h"
 #include "mozilla/image/WebRenderImageProvider.h"
 #include "mozilla/layers/RenderRootStateManager.h"
@@ -112,6 +114,102 @@ static already_AddRefed<imgIContainer> GetSymbolicIconImage(nsAtom* aName,
   return do_AddRef(lookup.Data().mImage);
 }
 
+// The sub-images of a border-image source for each of the nine components,
+// kept on the frame across paints. Besides saving the ImageOps::Clip calls,
+// this lets each ClippedImage keep the temporary surface it may need to draw
+// through, instead of redrawing it on every paint.
+using BorderImageSubImageKey =
+    std::tuple<nsCOMPtr<imgIContainer>, nsIntRect, Maybe<nsSize>>;
+// An estimate of the bytes of the surface a cached sub-image may keep alive,
+// from the largest size it was drawn at. The total over all the caches is kept
+// under kMaxTotal by not caching any more sub-images once it's reached.
+class BorderImageSubImageBytes {
+ public:
+  static constexpr int64_t kMaxTotal = 32 * 1024 * 1024;
+
+  static bool Fits(int64_t aBytes) { return sTotal + aBytes <= kMaxTotal; }
+
+  int64_t Get() const { return mBytes; }
+
+  BorderImageSubImageBytes() = default;
+  explicit BorderImageSubImageBytes(int64_t aBytes) : mBytes(aBytes) {
+    sTotal += mBytes;
+  }
+  BorderImageSubImageBytes(BorderImageSubImageBytes&& aOther)
+      : mBytes(std::exchange(aOther.mBytes, 0)) {}
+  BorderImageSubImageBytes& operator=(BorderImageSubImageBytes&& aOther) {
+    sTotal -= mBytes;
+    mBytes = std::exchange(aOther.mBytes, 0);
+    return *this;
+  }
+  ~BorderImageSubImageBytes() { sTotal -= mBytes; }
+
+ private:
+  static inline int64_t sTotal = 0;
+  int64_t mBytes = 0;
+};
+
+struct BorderImageSubImageEntry {
+  BorderImageSubImageKey mKey;
+  nsCOMPtr<imgIContainer> mSubImage;
+  BorderImageSubImageBytes mBytes;
+};
+struct BorderImageSubImageCache final
+    : public mozilla::MruCache<BorderImageSubImageKey, BorderImageSubImageEntry,
+                               BorderImageSubImageCache, 9> {
+  static HashNumber Hash(const KeyType& aKey) {
+    const nsIntRect& rect = std::get<1>(aKey);
+    const Maybe<nsSize>& viewport = std::get<2>(aKey);
+    return AddToHash(
+        HashGeneric(std::get<0>(aKey).get(), rect.x, rect.y, rect.width,
+                    rect.height),
+        viewport ? HashGeneric(viewport->width, viewport->height) : 0);
+  }
+  static bool Match(const KeyType& aKey, const ValueType& aVal) {
+    return aVal.mKey == aKey;
+  }
+
+  // The source image of the entries. When the frame's border-image changes,
+  // we drop all of them, rather than keep the old image alive until each
+  // entry gets overwritten. Only compared against.
+  const imgIContainer* mSource = nullptr;
+};
+
+NS_DECLARE_FRAME_PROPERTY_DELETABLE(BorderImageSubImageCacheProp,
+                                    BorderImageSubImageCache);
+
+// Returns whether aFrame is within about a viewport of the visible area of its
+// document. Frames further away don't get their image loads boosted when
+// painted, so that they don't compete with the images the user is looking at.
+static bool IsNearViewport(nsIFrame* aFrame) {
+  switch (aFrame->GetVisibility()) {
+    case Visibility::ApproximatelyVisible:
+      return true;
+    case Visibility::ApproximatelyNonVisible:
+      return false;
+    case Visibility::Untracked:
+      break;
+  }
+
+  // Most frames with CSS images don't track their visibility, so fall back to
+  // comparing our position to the root scroll port.
+  ScrollContainerFrame* sf = aFrame->PresShell()->GetRootScrollContainerFrame();
+  if (!sf) {
+    return true;
+  }
+  nsIFrame* scrolledFrame = sf->GetScrolledFrame();
+  if (!nsLayoutUtils::IsProperAncestorFrame(scrolledFrame, aFrame)) {
+    return true;  // Fixed-position content, for example, is always near.
+  }
+  nsRect nearRect(sf->GetScrollPosition(), sf->GetScrollPortRect().Size());
+  nearRect.Inflate(nearRect.width, nearRect.height);
+  const nsRect frameRect(aFrame->GetOffsetTo(scrolledFrame),
+                         aFrame->GetSize());
+  // Note that frameRect may be empty, so we can't use nsRect::Intersects.
+  return frameRect.x <= nearRect.XMost() && frameRect.XMost() >= nearRect.x &&
+         frameRect.y <= nearRect.YMost() && frameRect.YMost() >= nearRect.y;
+}
+
 bool nsImageRenderer::PrepareImage() {
   if (mImage->IsNone()) {
     mPrepareResult = ImgDrawResult::BAD_IMAGE;
@@ -139,8 +237,11 @@ bool nsImageRenderer::PrepareImage() {
         imgIContainer::FLAG_ASYNC_NOTIFY |
         imgIContainer::FLAG_AVOID_REDECODE_FOR_SIZE);
 
-    // Boost the loading priority since we know we want to draw the image.
-    if (mFlags & nsImageRenderer::FLAG_PAINTING_TO_WINDOW) {
+    // Boost the loading priority since we know we want to draw the image, but
+    // only if it's close enough to the viewport that it's likely to be seen
+    // soon. Far away frames get boosted once they're painted nearer to it.
+    if ((mFlags & nsImageRenderer::FLAG_PAINTING_TO_WINDOW) &&
+        IsNearViewport(mForFrame)) {
       request->BoostPriority(imgIRequest::CATEGORY_DISPLAY);
     }
 
@@ -988,25 +1089,39 @@ ImgDrawResult nsImageRenderer::DrawBorderImageComponent(
     // Retrieve or create the subimage we'll draw.
     nsIntRect srcRect(aSrc.x, aSrc.y, aSrc.width, aSrc.height);
     if (hasImage) {
-      subImage = ImageOps::Clip(mImageContainer, srcRect, aSVGViewportSize);
+      // The sub-image gets drawn, and maybe rasterized, at the size of a
+      // single tile, or of the whole fill area if it doesn't need scaling.
+      nsSize drawSize = aFill.Size();
+      if (RequiresScaling(aFill, aHFill, aVFill, aUnitSize)) {
+        nsSize repeatSize;
+        nsRect fillRect(aFill);
+        drawSize =
+            ComputeTile(fillRect, aHFill, aVFill, aUnitSize, repeatSize).Size();
+      }
+      const MatrixScalesDouble scale =
+          aRenderingContext.CurrentMatrixDouble().ScaleFactors();
+      const int32_t appUnitsPerDevPixel = aPresContext->AppUnitsPerDevPixel();
+      const gfxSize drawnPixels(
+          NSAppUnitsToDoublePixels(drawSize.width, appUnitsPerDevPixel) *
+              std::abs(scale.xScale),
+          NSAppUnitsToDoublePixels(drawSize.height, appUnitsPerDevPixel) *
+              std::abs(scale.yScale));
+      subImage =
+          GetBorderImageSubImage(srcRect, aSVGViewportSize, drawnPixels);
     } else {
-      // This path, for Element, is currently slower than it
-      // needs to be because we don't cache anything. (In particular, if we have
-      // to draw to a temporary surface inside ClippedImage, we don't cache that
-      // temporary surface since we immediately throw the ClippedImage we create
-      // here away.) However, if we did cache, we'd need to know when to
-      // invalidate that cache, and it's not clear that it's worth the trouble
-      // since using border-image with -moz-element is rare.
-
-      RefPtr<gfxDrawable> drawable =
-          DrawableForElement(nsRect(nsPoint(), mSize), aRenderingContext);
-      if (!drawable) {
-        NS_WARNING("Could not create drawable for element");
-        return ImgDrawResult::TEMPORARY_ERROR;
+      // The element may paint differently each time, so we don't keep its
+      // sub-images across paints, but we only snapshot it once for all the
+      // components we draw with this renderer.
+      if (!mElementImage) {
+        RefPtr<gfxDrawable> drawable =
+            DrawableForElement(nsRect(nsPoint(), mSize), aRenderingContext);
+        if (!drawable) {
+          NS_WARNING("Could not create drawable for element");
+          return ImgDrawResult::TEMPORARY_ERROR;
+        }
+        mElementImage = ImageOps::CreateFromDrawable(drawable);
       }
-
-      nsCOMPtr<imgIContainer> image(ImageOps::CreateFromDrawable(drawable));
-      subImage = ImageOps::Clip(image, srcRect, aSVGViewportSize);
+      subImage = ImageOps::Clip(mElementImage, srcRect, aSVGViewportSize);
     }
 
     MOZ_ASSERT(!aSVGViewportSize ||
@@ -1054,6 +1169,68 @@ ImgDrawResult nsImageRenderer::DrawBorderImageComponent(
               destTile.TopLeft(), repeatSize, aSrc);
 }
 
+already_AddRefed<imgIContainer> nsImageRenderer::GetBorderImageSubImage(
+    const nsIntRect& aSrcRect, const Maybe<nsSize>& aSVGViewportSize,
+    const gfxSize& aDrawnPixels) {
+  MOZ_ASSERT(mImageContainer);
+
+  // A ClippedImage may need a surface of the size it's drawn at, which for
+  // vector images, or raster ones drawn scaled up, can be much larger than the
+  // source rect, so count whichever is larger.
+  const double pixels =
+      std::max(double(aSrcRect.width) * aSrcRect.height,
+               std::ceil(aDrawnPixels.width) * std::ceil(aDrawnPixels.height));
+
+  // Sub-images of incomplete or animated images would hold on to stale
+  // pixels, and we don't want to keep huge temporary surfaces alive.
+  constexpr int64_t kMaxCachedSubImageBytes = 4 * 1024 * 1024;
+  bool animated = false;
+  if (!mImage->IsComplete() ||
+      NS_FAILED(mImageContainer->GetAnimated(&animated)) || animated ||
+      pixels * 4 > kMaxCachedSubImageBytes) {
+    if (auto* cache = mForFrame->GetProperty(BorderImageSubImageCacheProp())) {
+      cache->Remove(
+          std::make_tuple(mImageContainer, aSrcRect, aSVGViewportSize));
+    }
+    return ImageOps::Clip(mImageContainer, aSrcRect, aSVGViewportSize);
+  }
+  const int64_t bytes = int64_t(pixels) * 4;
+
+  auto key = std::make_tuple(mImageContainer, aSrcRect, aSVGViewportSize);
+  auto* cache =
+      mForFrame->GetOrCreateDeletableProperty(BorderImageSubImageCacheProp());
+  if (cache->mSource != mImageContainer) {
+    cache->Clear();
+    cache->mSource = mImageContainer;
+  }
+  auto lookup = cache->Lookup(key);
+  if (lookup) {
+    BorderImageSubImageEntry& entry = lookup.Data();
+    const int64_t growth = bytes - entry.mBytes.Get();
+    if (growth <= 0) {
+      return do_AddRef(entry.mSubImage);
+    }
+    // We're drawing it larger than before, so it may keep a larger surface.
+    nsCOMPtr<imgIContainer> subImage = entry.mSubImage;
+    if (!BorderImageSubImageBytes::Fits(growth)) {
+      cache->Remove(key);
+      return subImage.forget();
+    }
+    entry.mBytes = BorderImageSubImageBytes(bytes);
+    return subImage.forget();
+  }
+  nsCOMPtr<imgIContainer> subImage =
+      ImageOps::Clip(mImageContainer, aSrcRect, aSVGViewportSize);
+  // Once all the caches retain too much, stop caching rather than evicting
+  // from other frames, whose sub-images are as likely to be painted again.
+  if (!BorderImageSubImageBytes::Fits(bytes)) {
+    return subImage.forget();
+  }
+  lookup.Set(BorderImageSubImageEntry{std::move(key), std::move(subImage),
+                                      BorderImageSubImageBytes(bytes)});
+  return do_AddRef(lookup.Data().mSubImage);
+}
+
 ImgDrawResult nsImageRenderer::DrawShapeImage(nsPresContext* aPresContext,
                                               gfxContext& aRenderingContext) {
   if (!IsReady()) {
@@ -6,6 +6,7 @@
 #define nsImageRenderer_h_
 
 #include "Units.h"
+#include "gfxPoint.h"
 #include "mozilla/AspectRatio.h"
 #include "mozilla/SurfaceFromElementResult.h"
 #include "nsStyleStruct.h"
@@ -292,6 +293,16 @@ class nsImageRenderer {
   already_AddRefed<gfxDrawable> DrawableForElement(const nsRect& aImageRect,
                                                    gfxContext& aContext);
 
+  /**
+   * Returns mImageContainer clipped to aSrcRect for drawing a border-image
+   * component, reusing the sub-image from previous paints of mForFrame when
+   * possible. aDrawnPixels is the size in device pixels it's about to be
+   * drawn at, which bounds the surface it may keep alive.
+   */
+  already_AddRefed<imgIContainer> GetBorderImageSubImage(
+      const nsIntRect& aSrcRect, const mozilla::Maybe<nsSize>& aSVGViewportSize,
+      const gfxSize& aDrawnPixels);
+
   nsIFrame* mForFrame;
   const mozilla::StyleImage* mImage;
   ImageResolution mImageResolution;
@@ -300,6 +311,9 @@ class nsImageRenderer {
   const mozilla::StyleGradient* mGradientData;
   nsIFrame* mPaintServerFrame;
   SurfaceFromElementResult mImageElementSurface;
+  // The element image drawn by DrawBorderImageComponent, shared by all the
+  // components drawn with this renderer.
+  nsCOMPtr<imgIContainer> mElementImage;
   ImgDrawResult mPrepareResult;
   nsSize mSize;  // unscaled size of the image, in app units
   uint32_t mFlags;
@@ -802,6 +802,11 @@ pref("dom.forms.selectSearch", false);
 
 pref("dom.cycle_collector.incremental", true);
 
+// Approximate number of bytes that each of the content and chrome caches of
+// parsed querySelector() selectors may use before evicting the least recently
+// used ones. 0 means no limit other than time-based expiration.
+pref("dom.selector_cache.max_bytes", 4194304);
+
 // List of domains exempted from RFP. The list is comma separated domain list.
 pref("privacy.resistFingerprinting.exemptedDomains", "*.example.invalid");
 